@@ -9,10 +9,35 @@
  *  switches identities at heterozygous SNPs), false SNP count, etc.             *
  *                                                                               *
  * Syntax: HapSNPeval -p true_haplotype_prefix input_alignment.fa                *
+ *         HapSNPeval -p true_haplotype_prefix -b batch_manifest.txt             *
+ *         HapSNPeval -p true_haplotype_prefix -g alignments_pattern             *
+ *         HapSNPeval -p true_haplotype_prefix -C contig_pattern genome.fa       *
+ *         HapSNPeval -p true_haplotype_prefix -k ploidy input_alignment.fa      *
+ *         HapSNPeval -p true_haplotype_prefix -R start-end -P part.hsp in.fa    *
+ *         HapSNPeval -T truth.hti test_alignment.fa                             *
+ *         HapSNPeval pack -p true_haplotype_prefix input_alignment.fa out.hsa   *
+ *         HapSNPeval truth -p true_haplotype_prefix input_alignment.fa out.hti  *
+ *         HapSNPeval merge part.hsp...                                          *
  *  input_alignment.fa:   Path to the multiple sequence alignment of the two true*
  *                        haplotypes with the two test haplotypes, in alignment  *
  *                        FASTA format                                           *
  *  true_haplotype_prefix:Prefix of the header string for each true haplotype    *
+ *  batch_manifest.txt:   File listing one input alignment path (or glob pattern)*
+ *                        per line, optionally followed by a tab and the true    *
+ *                        haplotype prefix for its alignments                    *
+ *  alignments_pattern:   Glob pattern (quoted) matching the input alignments    *
+ *  start-end:            Range of columns (from 1) to evaluate                  *
+ *  part.hsp:             Partial result of a range, for the merge subcommand    *
+ *  ploidy:               Number of true haplotypes, and of test haplotypes      *
+ *  contig_pattern:       Extended regular expression picking the contig name    *
+ *                        out of each header (its first parenthesised            *
+ *                        subexpression, if any)                                 *
+ *  genome.fa:            Alignment holding the four records of each contig      *
+ *  truth.hti:            Truth index written by the truth subcommand, against   *
+ *                        which the test haplotypes of test_alignment.fa are     *
+ *                        evaluated                                              *
+ *                                                                               *
+ * Compile with: g++ -O3 -pthread -o HapSNPeval HapSNPeval.cpp -lz               *
  *                                                                               *
  * Design:                                                                       *
  *  The general idea is to identify and read in the true and test haplotype      *
@@ -21,6 +46,91 @@
  *  to the previous identity of that test haplotype (to count switching errors), *
  *  as well as assessing deviations from homozygosity in the test haplotypes at  *
  *  homozygous sites in the true haplotypes, etc.                                *
+ *  Columns are classified 64 at a time by a vectorized kernel producing one     *
+ *  bitmask per class of column (false indel, false SNP, het SNP, bad call...),  *
+ *  with the counts taken from popcounts of the bitmasks.  That pass counts the  *
+ *  homozygous columns and builds a sorted index of the true het SNP and true    *
+ *  indel columns; only those sites are then gathered into contiguous columns    *
+ *  for the switch and bad call counts, which the kernel takes 64 sites at a     *
+ *  time.  Phase switches are counted from the XOR of adjacent identity bits     *
+ *  once these are compressed to the informative het SNPs (with PEXT where       *
+ *  available).                                                                  *
+ *  Groups of 64 columns where all four records are identical, which hold no     *
+ *  events and make up most of a typical alignment, are skipped after a single   *
+ *  comparison, and the runs of identical columns found along the way are        *
+ *  reported with -r (--run_stats).                                              *
+ *  The kernels (and the FASTA tokenizer) are built in scalar, SSE4.2, AVX2 and  *
+ *  AVX-512BW variants, and the best one the CPU supports is chosen at startup.  *
+ *  Columns outside the kernel (and all of them with -m table) are classified    *
+ *  branch-free through a table indexed by the column's equality and gap tests.  *
+ *  With -c case or -c iupac, soft-masked lowercase bases match uppercase, and   *
+ *  IUPAC ambiguity codes match the bases they include, normalized in the same   *
+ *  pass by byte shuffles (or the tables, in the scalar code).                   *
+ *  The per-column loop that reports event positions (as text with -o, binary    *
+ *  records with -e, or to a callback) is a template on the reporting policy,    *
+ *  so the summary-only path carries no reporting code.                          *
+ *  With more than one thread (-t), the columns of a mapped alignment with       *
+ *  fixed-width lines (or of a packed cache) are split into one chunk per        *
+ *  thread; each chunk's counters and its identities at its first and last       *
+ *  informative het SNPs are merged in order, adding a switch wherever the       *
+ *  identities either side of a chunk boundary differ.                           *
+ *  The alignment file is memory-mapped, and the four records are located in     *
+ *  place, so the comparison runs directly over the newline-free segments of     *
+ *  the mapped records without copying any lines.                                *
+ *  With -s (--stream), the records are instead located with one pass over the   *
+ *  file, and four cursors advance in lockstep through fixed-size buffers, so    *
+ *  peak memory use does not depend on the length of the alignment.              *
+ *  Gzipped input is decompressed in memory, with the independent blocks of      *
+ *  BGZF input inflated in parallel on -t (--threads) threads.  From a pipe, it  *
+ *  is instead inflated a buffer of blocks at a time on a reader thread, and     *
+ *  evaluated as it arrives.  With -s, each of the four cursors inflates its own *
+ *  stream of the file through fixed-size buffers, so memory use stays fixed for *
+ *  compressed input too.  For BGZF input, the block each record starts in is    *
+ *  noted while locating the records, so its cursor starts inflating there, a    *
+ *  buffer of blocks at a time in parallel.                                      *
+ *  If a samtools .fai index is present (or generated with -f/--faidx), the      *
+ *  records are looked up by name in the index, and only their bytes are read.   *
+ *  When the lines of a record have a fixed width (from the index, from the      *
+ *  line lengths seen while locating the records with -s, or verified with one   *
+ *  byte per line), line ends are computed arithmetically, and short             *
+ *  lines are packed into long contiguous blocks with memcpy.                    *
+ *  Standard input (-) and pipes are read sequentially through a fixed-size      *
+ *  buffer: the first three records to arrive are held in memory, and the last   *
+ *  is evaluated as it arrives, so nothing is staged on disk.                    *
+ *  When streaming or reading a pipe with more than one thread, a reader thread  *
+ *  fills chunk buffers ahead of the evaluation, handing them over through       *
+ *  lock-free single-producer/single-consumer queues so I/O overlaps compute.    *
+ *  With -b (--batch) or -g (--glob), each alignment listed in a manifest (or    *
+ *  matching a pattern) is evaluated, with many file reads kept in flight        *
+ *  through io_uring (or pread where io_uring is unavailable) while worker       *
+ *  threads evaluate the files already loaded.  The loaded files are dealt to    *
+ *  per-worker queues, and a worker whose queue runs dry steals from the         *
+ *  others; the results table is in manifest order.                              *
+ *  The pack subcommand stores the four records in a packed alignment cache      *
+ *  (.hsa) of 4-bit codes with a checksum, which later runs map and decode in    *
+ *  place of the FASTA.                                                          *
+ *  With pack -i, the records are interleaved column by column instead, so       *
+ *  evaluation reads one sequential stream rather than four.                     *
+ *  The truth subcommand writes a truth index (.hti) of one true haplotype's     *
+ *  packed bases plus the columns where the true haplotypes differ, so that many *
+ *  test alignments against the same truth (-T) read only their test records     *
+ *  and classify only those columns as candidate SNPs or indels.                 *
+ *  With -C (--contigs), the records are grouped into contigs by the part of     *
+ *  each header the pattern matches, and the contigs are evaluated in parallel,  *
+ *  longest first, for a per-contig table and genome-wide totals.  No switch is  *
+ *  counted across the boundary between two contigs.                             *
+ *  With -k (--ploidy) above 2, each test haplotype keeps the set of true        *
+ *  haplotypes it has matched at every informative het SNP since its last        *
+ *  switch, as a bitmask, and a switch is counted when no true haplotype is      *
+ *  left in the set, so the cost grows with the ploidy rather than with the      *
+ *  number of ways to assign test haplotypes to true ones.                       *
+ *  With -R (--region), cursors start straight at the first column of the        *
+ *  range, so an alignment can be sharded across processes or nodes.  With -P    *
+ *  (--partial), the state is written to a partial result (.hsp) instead of      *
+ *  the summary: the counters, plus the identities of each test haplotype at     *
+ *  the first and last informative het SNPs of the range.  The merge             *
+ *  subcommand checks that the ranges tile the alignment, and merges their       *
+ *  states in order just as the threads' chunks are merged.                      *
  *  This program should allow high throughput assessment of haplotypes           *
  *  reconstructed from simulated read data using various haplotype assembly      *
  *  software/pipelines, primarily with regards to SNP phasing.                   *
@@ -30,38 +140,5053 @@
 #include <fstream>
 #include <string>
 #include <cstdio>
+#include <cstddef>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <stdint.h>
 #include <getopt.h>
+#include <glob.h>
+#include <regex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <zlib.h>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_SIMD_VARIANTS 1
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+ 
+using namespace std;
+ 
+//Record indices within the array of alignment records:
+enum {
+   TRUE_ONE = 0,
+   TRUE_TWO = 1,
+   TEST_ONE = 2,
+   TEST_TWO = 3,
+   NUM_RECORDS = 4
+};
+ 
+//Sorted columns (0-based, from the start of the alignment) of the true het
+// SNPs and true indels, the only columns switches and bad calls depend on:
+struct SiteIndex {
+   vector<uint64_t> het_snps;
+   vector<uint64_t> true_indels;
+   void clear() {
+      het_snps.clear();
+      true_indels.clear();
+   }
+};
+ 
+//Buffers reused by every block a state evaluates, since streamed and piped
+// input is evaluated a line at a time.  They hold nothing between blocks, so
+// copying a state doesn't copy them:
+struct EvalScratch {
+   SiteIndex slice_sites;
+   vector<char> gathered;
+   vector<uint64_t> site_masks;
+   EvalScratch() {}
+   EvalScratch(const EvalScratch &) {}
+   EvalScratch &operator=(const EvalScratch &) { return *this; }
+};
+ 
+//Statistics of the runs of columns where all four records have the same byte,
+// which can't hold any event.  The runs at either end are kept so that the
+// statistics of adjacent ranges of columns can be merged:
+struct RunStats {
+   uint64_t columns; //Columns looked at
+   uint64_t identical_columns;
+   uint64_t runs;
+   uint64_t longest_run;
+   uint64_t leading_run, trailing_run;
+   uint64_t skipped_columns; //Identical columns skipped in whole groups of 64
+   RunStats() : columns(0), identical_columns(0), runs(0), longest_run(0),
+                leading_run(0), trailing_run(0), skipped_columns(0) {}
+   //Add the next n (1 to 64) columns, given a bitmask of those that are identical.
+   //The runs at either end of the group are taken without branching, since
+   // groups with and without differences are mixed unpredictably:
+   void add(uint64_t identical, unsigned int n) {
+      uint64_t different = ~identical & (n == 64 ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1);
+      uint64_t first_run = different != 0 ? __builtin_ctzll(different) : n;
+      uint64_t last_run = different != 0 ? __builtin_clzll(different << (64 - n)) : n;
+      identical_columns += __builtin_popcountll(identical);
+      runs += __builtin_popcountll(identical & ~((identical << 1) | (trailing_run != 0)));
+      leading_run += leading_run == columns ? first_run : 0;
+      longest_run = max(longest_run, trailing_run + first_run);
+      //A run within the group is shorter than 64, so it only matters while no longer run has been seen:
+      if (longest_run < 64) {
+         uint64_t x = identical;
+         uint64_t length = 0;
+         for (; x != 0; length++) {
+            x &= x >> 1;
+         }
+         longest_run = max(longest_run, length);
+      }
+      trailing_run = different != 0 ? last_run : trailing_run + n;
+      longest_run = max(longest_run, trailing_run);
+      columns += n;
+   }
+};
+ 
+//Merge the run statistics of the columns that follow into those of the
+// columns before them, joining the runs that meet at the boundary:
+void merge_run_stats(RunStats &runs, const RunStats &next) {
+   runs.runs += next.runs - (runs.trailing_run != 0 && next.leading_run != 0);
+   runs.longest_run = max(max(runs.longest_run, next.longest_run), runs.trailing_run + next.leading_run);
+   runs.leading_run += runs.leading_run == runs.columns ? next.leading_run : 0;
+   runs.trailing_run = next.trailing_run == next.columns ? runs.trailing_run + next.trailing_run : next.trailing_run;
+   runs.columns += next.columns;
+   runs.identical_columns += next.identical_columns;
+   runs.skipped_columns += next.skipped_columns;
+}
+ 
+//Counters and phase state accumulated while iterating along the alignment.
+//The identity (1 or 2, or 0 before any) of each test haplotype at the first
+// and the latest informative het SNP let the states of adjacent ranges of
+// columns be merged.
+//If sites is set, the site index built along the way (when events aren't
+// reported) is kept there for other metrics to reuse:
+struct HapEvalState {
+   unsigned short int test_one_id, test_two_id;
+   unsigned short int test_one_first_id, test_two_first_id;
+   unsigned long int test_one_switches, test_two_switches,
+                     test_one_false_snps, test_two_false_snps,
+                     test_one_false_indels, test_two_false_indels,
+                     test_one_bad_calls, test_two_bad_calls;
+   RunStats runs; //Gathered when events aren't reported
+   SiteIndex *sites;
+   EvalScratch scratch;
+   HapEvalState() : test_one_id(0), test_two_id(0),
+                    test_one_first_id(0), test_two_first_id(0),
+                    test_one_switches(0), test_two_switches(0),
+                    test_one_false_snps(0), test_two_false_snps(0),
+                    test_one_false_indels(0), test_two_false_indels(0),
+                    test_one_bad_calls(0), test_two_bad_calls(0), sites(0) {}
+};
+ 
+//Merge the state of the columns that follow into the state of the columns
+// before them, counting a switch where the identities either side differ:
+void merge_states(HapEvalState &state, const HapEvalState &next) {
+   state.test_one_switches += next.test_one_switches + (state.test_one_id != 0 && next.test_one_first_id != 0 && state.test_one_id != next.test_one_first_id);
+   state.test_two_switches += next.test_two_switches + (state.test_two_id != 0 && next.test_two_first_id != 0 && state.test_two_id != next.test_two_first_id);
+   state.test_one_first_id = state.test_one_first_id != 0 ? state.test_one_first_id : next.test_one_first_id;
+   state.test_two_first_id = state.test_two_first_id != 0 ? state.test_two_first_id : next.test_two_first_id;
+   state.test_one_id = next.test_one_id != 0 ? next.test_one_id : state.test_one_id;
+   state.test_two_id = next.test_two_id != 0 ? next.test_two_id : state.test_two_id;
+   state.test_one_false_snps += next.test_one_false_snps;
+   state.test_two_false_snps += next.test_two_false_snps;
+   state.test_one_false_indels += next.test_one_false_indels;
+   state.test_two_false_indels += next.test_two_false_indels;
+   state.test_one_bad_calls += next.test_one_bad_calls;
+   state.test_two_bad_calls += next.test_two_bad_calls;
+   merge_run_stats(state.runs, next.runs);
+}
+ 
+//Add the state of a contig into the genome-wide totals.  Unlike adjacent
+// ranges of columns, separate contigs share no phase, so no switch is counted
+// between them and runs of identical columns aren't joined across them:
+void add_contig_state(HapEvalState &genome, const HapEvalState &contig) {
+   genome.test_one_id = 0;
+   genome.test_two_id = 0;
+   genome.runs.trailing_run = 0;
+   merge_states(genome, contig);
+}
+ 
+//The columns [start, end) of an alignment to evaluate, all of them by default:
+struct ColumnRange {
+   size_t start, end;
+   size_t alignment_length; //Columns in the whole alignment, once known
+   ColumnRange() : start(0), end(SIZE_MAX), alignment_length(0) {}
+   size_t length() const { return end - start; }
+   //Fit the range to an alignment of the given length, covering all of it if
+   // no range was given, returning false if the range ends beyond it:
+   bool clip(size_t length) {
+      alignment_length = length;
+      if (end == SIZE_MAX) {
+         end = length;
+      }
+      return end <= length;
+   }
+};
+ 
+//A FASTA record located within the alignment file, as byte offsets from the start of the file:
+struct AlignmentRecord {
+   string header;
+   size_t seq_start; //Offset of the first byte of the sequence lines
+   size_t seq_end; //Offset one past the last byte of the sequence lines
+   size_t length; //Number of alignment columns (sequence bytes excluding newlines)
+   size_t line_bases; //Bases per line if all lines but the last are known to be this long, otherwise 0
+   size_t line_width; //Bytes per line including the line terminator, if line_bases is known
+   size_t bgzf_offset; //When streaming BGZF input, the compressed offset of the block holding seq_start
+   size_t bgzf_start; //and the offset of the start of that block, once inflated
+   bool found;
+   AlignmentRecord() : header(""), seq_start(0), seq_end(0), length(0), line_bases(0), line_width(0), bgzf_offset(0), bgzf_start(0), found(false) {}
+};
+ 
+//The four records of one contig of a multi-contig alignment, and the result
+// of evaluating them:
+struct ContigGroup {
+   string name;
+   AlignmentRecord records[NUM_RECORDS];
+   unsigned short int records_found;
+   int status; //0 unless the records are incomplete or evaluating them failed, then the exit status for the error
+   HapEvalState state;
+   ContigGroup() : records_found(0), status(0) {}
+};
+ 
+//Returns true if the buffer starts with the gzip magic number:
+bool is_gzip(const char *data, size_t size) {
+   return size >= 2 && (unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b;
+}
+ 
+//Read a little-endian unsigned integer of the given width:
+inline uint32_t read_le(const unsigned char *bytes, unsigned short int width) {
+   uint32_t value = 0;
+   for (unsigned short int i = width; i > 0; i--) {
+      value = (value << 8) | bytes[i-1];
+   }
+   return value;
+}
+ 
+//A BGZF block's deflate payload within the compressed file, and where its
+// decompressed contents go in the output:
+struct BgzfBlock {
+   size_t block_offset;
+   size_t payload_offset, payload_size;
+   size_t output_offset, output_size;
+   uint32_t crc;
+};
+ 
+//Largest possible BGZF block, compressed or not:
+const size_t BGZF_MAX_BLOCK_SIZE = 1 << 16;
+ 
+//Parse the BGZF block starting at pos, whose output starts at output_offset,
+// returning its size, or 0 if there isn't a whole BGZF block there:
+size_t parse_bgzf_block(const char *data, size_t pos, size_t size, size_t output_offset, BgzfBlock &block) {
+   const unsigned char *bytes = (const unsigned char *)data;
+   //Fixed gzip header with FEXTRA set, then the BC subfield holding the block size:
+   if (size - pos < 18 || bytes[pos] != 0x1f || bytes[pos+1] != 0x8b || bytes[pos+2] != 8 || !(bytes[pos+3] & 4)) {
+      return 0;
+   }
+   size_t extra_length = read_le(bytes+pos+10, 2);
+   size_t block_size = 0;
+   for (size_t field = pos+12; field + 4 <= pos+12+extra_length && field + 4 <= size; ) {
+      size_t field_length = read_le(bytes+field+2, 2);
+      if (bytes[field] == 'B' && bytes[field+1] == 'C' && field_length == 2 && field + 6 <= size) {
+         block_size = read_le(bytes+field+4, 2) + 1;
+         break;
+      }
+      field += 4 + field_length;
+   }
+   if (block_size < 20 + extra_length || block_size > size - pos) {
+      return 0;
+   }
+   block.block_offset = pos;
+   block.payload_offset = pos + 12 + extra_length;
+   block.payload_size = block_size - extra_length - 20;
+   block.crc = read_le(bytes+pos+block_size-8, 4);
+   block.output_size = read_le(bytes+pos+block_size-4, 4);
+   block.output_offset = output_offset;
+   return block_size;
+}
+ 
+//Split a BGZF file into its blocks, returning false if the file isn't BGZF:
+bool find_bgzf_blocks(const char *data, size_t size, vector<BgzfBlock> &blocks, size_t &total_size) {
+   size_t pos = 0;
+   total_size = 0;
+   while (pos < size) {
+      BgzfBlock block;
+      size_t block_size = parse_bgzf_block(data, pos, size, total_size, block);
+      if (block_size == 0) {
+         return false;
+      }
+      total_size += block.output_size;
+      blocks.push_back(block);
+      pos += block_size;
+   }
+   return true;
+}
+ 
+//Inflate one BGZF block directly into its place in the output buffer:
+bool inflate_bgzf_block(const char *data, const BgzfBlock &block, char *output) {
+   z_stream stream;
+   memset(&stream, 0, sizeof(stream));
+   if (inflateInit2(&stream, -15) != Z_OK) { //Raw deflate, the gzip wrapper was parsed already
+      return false;
+   }
+   stream.next_in = (Bytef *)(data + block.payload_offset);
+   stream.avail_in = (uInt)block.payload_size;
+   stream.next_out = (Bytef *)(output + block.output_offset);
+   stream.avail_out = (uInt)block.output_size;
+   int status = inflate(&stream, Z_FINISH);
+   inflateEnd(&stream);
+   return status == Z_STREAM_END && stream.avail_out == 0 &&
+          crc32(0, (const Bytef *)(output + block.output_offset), (uInt)block.output_size) == block.crc;
+}
+ 
+//Decompress a BGZF file, with the independent blocks spread over a pool of threads:
+bool inflate_bgzf(const char *data, const vector<BgzfBlock> &blocks, char *output, unsigned int num_threads) {
+   atomic<size_t> next_block(0);
+   atomic<bool> failed(false);
+   vector<thread> workers;
+   num_threads = max(1u, min(num_threads, (unsigned int)blocks.size()));
+   for (unsigned int i = 0; i < num_threads; i++) {
+      workers.push_back(thread([&]() {
+         size_t block;
+         while (!failed && (block = next_block++) < blocks.size()) {
+            if (!inflate_bgzf_block(data, blocks[block], output)) {
+               failed = true;
+            }
+         }
+      }));
+   }
+   for (unsigned int i = 0; i < num_threads; i++) {
+      workers[i].join();
+   }
+   return !failed;
+}
+ 
+//Decompress a (possibly multi-member) gzip file that isn't BGZF:
+bool inflate_gzip(const char *data, size_t size, vector<char> &output) {
+   z_stream stream;
+   memset(&stream, 0, sizeof(stream));
+   if (inflateInit2(&stream, 15 + 16) != Z_OK) { //Expect a gzip wrapper
+      return false;
+   }
+   stream.next_in = (Bytef *)data;
+   stream.avail_in = (uInt)min(size, (size_t)UINT_MAX);
+   size_t input_left = size - stream.avail_in;
+   output.resize(max(size * 4, (size_t)1 << 16));
+   size_t output_used = 0;
+   int status = Z_OK;
+   while (true) {
+      if (output_used == output.size()) {
+         output.resize(output.size() * 2);
+      }
+      stream.next_out = (Bytef *)(&output[0] + output_used);
+      stream.avail_out = (uInt)min(output.size() - output_used, (size_t)UINT_MAX);
+      size_t avail_out = stream.avail_out;
+      status = inflate(&stream, Z_NO_FLUSH);
+      output_used += avail_out - stream.avail_out;
+      if (stream.avail_in == 0 && input_left > 0) {
+         stream.avail_in = (uInt)min(input_left, (size_t)UINT_MAX);
+         input_left -= stream.avail_in;
+      }
+      if (status == Z_STREAM_END) {
+         if (stream.avail_in == 0 || !is_gzip((const char *)stream.next_in, stream.avail_in)) {
+            break; //Ignore any trailing garbage, as gzip does
+         }
+         inflateReset(&stream); //Concatenated gzip member
+      } else if (status != Z_OK && !(status == Z_BUF_ERROR && stream.avail_out == 0)) {
+         break;
+      }
+   }
+   inflateEnd(&stream);
+   output.resize(output_used);
+   return status == Z_STREAM_END;
+}
+ 
+//Decompress a gzipped alignment: BGZF blocks are decompressed in parallel
+// straight into the output, anything else is inflated serially:
+bool inflate_alignment(const char *data, size_t size, vector<char> &output, unsigned int num_threads) {
+   vector<BgzfBlock> blocks;
+   size_t inflated_size;
+   if (find_bgzf_blocks(data, size, blocks, inflated_size)) {
+      output.resize(inflated_size);
+      return inflated_size == 0 || inflate_bgzf(data, blocks, &output[0], num_threads);
+   }
+   return inflate_gzip(data, size, output);
+}
+ 
+//Bytes of compressed input held by a SequentialInput at a time:
+const size_t SEQUENTIAL_INPUT_SIZE = 1 << 22;
+ 
+//Reads an input front to back from a file descriptor (a pipe, or a file
+// from the given offset), inflating it on the fly if it's gzipped, so the
+// inflated bytes can be evaluated as they come without holding the whole
+// input in memory.
+//BGZF input is inflated a buffer of blocks at a time, with the blocks spread
+// over a pool of threads, and any other gzip input is inflated serially.
+//A buffer of blocks never inflates to more than input_size bytes, so memory
+// use is fixed:
+class SequentialInput {
+   public:
+      SequentialInput(int fd, unsigned int num_threads, size_t input_size = SEQUENTIAL_INPUT_SIZE, off_t start = -1) :
+         fd(fd), num_threads(num_threads), format(UNKNOWN), file_pos(start), input(max(input_size, BGZF_MAX_BLOCK_SIZE)),
+         input_offset(start >= 0 ? (size_t)start : 0), input_start(0), input_end(0), input_done(false), blocks_offset(0), output_start(0),
+         output_pos(0), stream_open(false) {
+         memset(&stream, 0, sizeof(stream));
+      }
+      ~SequentialInput() {
+         if (stream_open) {
+            inflateEnd(&stream);
+         }
+      }
+      //Fill the buffer with up to capacity bytes of the (inflated) input,
+      // returning 0 at the end of the input, or -1 if reading or inflating fails:
+      ssize_t read(char *buffer, size_t capacity) {
+         if (format == UNKNOWN && !detect_format()) {
+            return -1;
+         }
+         if (format == PLAIN) {
+            if (input_start < input_end) { //Bytes read while detecting the format
+               size_t length = min(capacity, input_end - input_start);
+               memcpy(buffer, &input[input_start], length);
+               input_start += length;
+               return (ssize_t)length;
+            }
+            return read_input(buffer, capacity);
+         }
+         if (format == GZIP) {
+            return read_gzip(buffer, capacity);
+         }
+         if (output_pos == output.size() && !inflate_blocks()) {
+            return -1;
+         }
+         size_t length = min(capacity, output.size() - output_pos);
+         if (length > 0) {
+            memcpy(buffer, &output[output_pos], length);
+         }
+         output_pos += length;
+         return (ssize_t)length;
+      }
+      //Read past the given number of (inflated) bytes, returning false if the
+      // input ends first or can't be read:
+      bool skip(size_t bytes) {
+         char discard[1 << 16];
+         while (bytes > 0) {
+            ssize_t bytes_read = read(discard, min(bytes, sizeof(discard)));
+            if (bytes_read <= 0) {
+               return false;
+            }
+            bytes -= (size_t)bytes_read;
+         }
+         return true;
+      }
+      bool compressed() const { return format == BGZF || format == GZIP; }
+      //Find the BGZF block that the given offset into the inflated input
+      // (counting from where reading started) falls in, among the blocks of the
+      // current buffer, giving its compressed offset and its inflated offset.
+      //Returns false if the input isn't BGZF or the offset isn't in the buffer:
+      bool block_at(size_t offset, size_t &block_offset, size_t &block_start) const {
+         if (format != BGZF || blocks.empty() || offset < output_start || offset > output_start + output.size()) {
+            return false;
+         }
+         size_t block = blocks.size() - 1;
+         while (block > 0 && output_start + blocks[block].output_offset > offset) {
+            block--;
+         }
+         block_offset = blocks_offset + blocks[block].block_offset;
+         block_start = output_start + blocks[block].output_offset;
+         return true;
+      }
+   private:
+      SequentialInput(const SequentialInput &);
+      SequentialInput &operator=(const SequentialInput &);
+      enum Format {UNKNOWN, PLAIN, BGZF, GZIP};
+      //Read the next bytes of the file, with pread from our own position if
+      // one was given, since a file descriptor may be shared with other readers:
+      ssize_t read_input(char *buffer, size_t capacity) {
+         ssize_t bytes_read;
+         do {
+            bytes_read = file_pos >= 0 ? pread(fd, buffer, capacity, file_pos) : ::read(fd, buffer, capacity);
+         } while (bytes_read < 0 && errno == EINTR);
+         if (bytes_read > 0 && file_pos >= 0) {
+            file_pos += bytes_read;
+         }
+         return bytes_read;
+      }
+      //Move the unconsumed input to the front of the buffer and top it up:
+      bool fill_input() {
+         if (input_start > 0) {
+            input_offset += input_start;
+            memmove(&input[0], &input[input_start], input_end - input_start);
+            input_end -= input_start;
+            input_start = 0;
+         }
+         while (!input_done && input_end < input.size()) {
+            ssize_t bytes_read = read_input(&input[input_end], input.size() - input_end);
+            if (bytes_read < 0) {
+               return false;
+            }
+            input_done = bytes_read == 0;
+            input_end += (size_t)bytes_read;
+         }
+         return true;
+      }
+      bool detect_format() {
+         if (!fill_input()) {
+            return false;
+         }
+         BgzfBlock block;
+         if (!is_gzip(&input[0], input_end)) {
+            format = PLAIN;
+         } else if (parse_bgzf_block(&input[0], 0, input_end, 0, block) > 0) {
+            format = BGZF;
+         } else {
+            format = GZIP;
+            if (inflateInit2(&stream, 15 + 16) != Z_OK) { //Expect a gzip wrapper
+               return false;
+            }
+            stream_open = true;
+         }
+         return true;
+      }
+      //Inflate every whole block in the input buffer in parallel, straight
+      // into the output buffer, leaving it empty at the end of the input:
+      bool inflate_blocks() {
+         if (!input_done && input_end - input_start < BGZF_MAX_BLOCK_SIZE && !fill_input()) {
+            return false;
+         }
+         blocks.clear();
+         size_t output_size = 0;
+         size_t pos = input_start;
+         while (pos < input_end) {
+            BgzfBlock block;
+            size_t block_size = parse_bgzf_block(&input[0], pos, input_end, output_size, block);
+            if (block_size == 0) {
+               if (!input_done && input_end - pos < BGZF_MAX_BLOCK_SIZE) { //Block continues past the buffer
+                  break;
+               }
+               return false;
+            }
+            if (!blocks.empty() && output_size + block.output_size > input.size()) { //Output buffer is full
+               break;
+            }
+            blocks.push_back(block);
+            output_size += block.output_size;
+            pos += block_size;
+         }
+         output_start += output.size();
+         blocks_offset = input_offset;
+         output.resize(output_size);
+         output_pos = 0;
+         if (output_size > 0 && !inflate_bgzf(&input[0], blocks, &output[0], num_threads)) {
+            return false;
+         }
+         input_start = pos;
+         if (output_size == 0 && blocks.size() > 0) { //Only empty blocks (like the end of file marker), so keep going
+            return inflate_blocks();
+         }
+         return true;
+      }
+      ssize_t read_gzip(char *buffer, size_t capacity) {
+         stream.next_out = (Bytef *)buffer;
+         stream.avail_out = (uInt)min(capacity, (size_t)UINT_MAX);
+         while (stream.avail_out == (uInt)min(capacity, (size_t)UINT_MAX) && stream_open) {
+            if (input_start == input_end) {
+               if (input_done) {
+                  return -1; //Truncated
+               }
+               if (!fill_input()) {
+                  return -1;
+               }
+               continue;
+            }
+            stream.next_in = (Bytef *)&input[input_start];
+            stream.avail_in = (uInt)(input_end - input_start);
+            int status = inflate(&stream, Z_NO_FLUSH);
+            input_start = input_end - stream.avail_in;
+            if (status == Z_STREAM_END) {
+               if (input_end - input_start < 2 && !input_done && !fill_input()) {
+                  return -1;
+               }
+               if (input_start == input_end || !is_gzip(&input[input_start], input_end - input_start)) {
+                  inflateEnd(&stream); //Ignore any trailing garbage, as gzip does
+                  stream_open = false;
+               } else {
+                  inflateReset(&stream); //Concatenated gzip member
+               }
+            } else if (status != Z_OK && status != Z_BUF_ERROR) {
+               return -1;
+            }
+         }
+         return (ssize_t)(min(capacity, (size_t)UINT_MAX) - stream.avail_out);
+      }
+      int fd;
+      unsigned int num_threads;
+      Format format;
+      off_t file_pos;
+      vector<char> input;
+      size_t input_offset; //Offset of the start of the input buffer within the file
+      size_t input_start, input_end;
+      bool input_done;
+      vector<BgzfBlock> blocks;
+      size_t blocks_offset; //Offset of the input buffer within the file when the blocks were found
+      vector<char> output;
+      size_t output_start; //Offset of the output buffer within the inflated input
+      size_t output_pos;
+      z_stream stream;
+      bool stream_open;
+};
+ 
+//Read-only memory mapping of the input alignment file, or its decompressed
+// contents if the file is gzipped:
+class MappedAlignment {
+   public:
+      MappedAlignment() : fd(-1), map(0), map_size(0), compressed(false), decompression_failed(false) {}
+      ~MappedAlignment() { close(); }
+      bool open(const string &path, unsigned int num_threads) {
+         struct stat file_stat;
+         fd = ::open(path.c_str(), O_RDONLY);
+         if (fd < 0 || fstat(fd, &file_stat) != 0) {
+            return false;
+         }
+         map_size = (size_t)file_stat.st_size;
+         if (map_size == 0) { //mmap can't map an empty file, but it's not an error
+            return true;
+         }
+         void *mapping = mmap(0, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (mapping == MAP_FAILED) {
+            map_size = 0;
+            return false;
+         }
+         map = (const char *)mapping;
+         madvise(mapping, map_size, MADV_SEQUENTIAL);
+         if (is_gzip(map, map_size)) {
+            compressed = true;
+            decompression_failed = !inflate_alignment(map, map_size, inflated, num_threads);
+            munmap((void *)map, map_size);
+            map = 0;
+            map_size = 0;
+         }
+         return true;
+      }
+      void close() {
+         if (map != 0) {
+            munmap((void *)map, map_size);
+            map = 0;
+         }
+         map_size = 0;
+         vector<char>().swap(inflated);
+         if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+         }
+      }
+      const char *data() const { return compressed ? (inflated.empty() ? 0 : &inflated[0]) : map; }
+      size_t size() const { return compressed ? inflated.size() : map_size; }
+      bool failed() const { return decompression_failed; }
+   private:
+      int fd;
+      const char *map;
+      size_t map_size;
+      bool compressed;
+      bool decompression_failed;
+      vector<char> inflated;
+};
+ 
+//Instruction set variants of the kernels:
+//The tokenizer and column classification kernels are compiled once per
+// instruction set (scalar, SSE4.2, AVX2 and AVX-512BW), each variant built
+// on one of the operation sets below, and the best variant the CPU supports
+// is selected at startup (or forced with -m/--simd for benchmarking).
+//The table variant is the scalar tokenizer with the lookup table classifier.
+enum SimdLevel {
+   SIMD_TABLE = 0,
+   SIMD_SCALAR = 1,
+   SIMD_SSE42 = 2,
+   SIMD_AVX2 = 3,
+   SIMD_AVX512BW = 4
+};
+ 
+const char *SIMD_LEVEL_NAMES[] = {"table", "scalar", "sse4.2", "avx2", "avx512bw"};
+ 
+//Base comparison modes (-c/--compare):
+//Bases are compared exactly by default.  The other modes fold lowercase
+// (soft-masked) letters to uppercase, and the IUPAC mode also lets two bases
+// match if the sets of nucleotides they stand for intersect, so an ambiguity
+// code matches any base it includes (N matches every base, but not a gap).
+//The normalization is done on the fly by each variant of the kernels (with
+// byte shuffles in the SIMD variants), so there's no separate pass over the
+// data, and the exact mode compiles to the plain byte comparisons.
+enum BaseComparison {
+   COMPARE_EXACT = 0,
+   COMPARE_CASE = 1,
+   COMPARE_IUPAC = 2
+};
+ 
+const char *BASE_COMPARISON_NAMES[] = {"exact", "case", "iupac"};
+ 
+//Nucleotide sets (A = 1, C = 2, G = 4, T = 8) of the uppercase letters, from
+// 0x40 ('@') to 0x5f ('_'), laid out as two 16 byte shuffle tables:
+const char IUPAC_CODES[32] = {0, 1, 14, 2, 13, 0, 0, 4, 11, 0, 0, 12, 0, 3, 15, 0,
+                              0, 0, 5, 6, 8, 8, 7, 9, 0, 10, 0, 0, 0, 0, 0, 0};
+ 
+//Case folding and nucleotide sets of every byte, for the scalar comparisons:
+class BaseTables {
+   public:
+      BaseTables() {
+         for (unsigned int c = 0; c < 256; c++) {
+            fold[c] = (unsigned char)(c >= 'a' && c <= 'z' ? c - 0x20 : c);
+            codes[c] = (unsigned char)((fold[c] & 0xe0) == 0x40 ? IUPAC_CODES[fold[c] & 0x1f] : 0);
+         }
+      }
+      unsigned char fold[256];
+      unsigned char codes[256];
+};
+ 
+const BaseTables base_tables;
+ 
+//Returns true if two bases match under a comparison mode:
+template <BaseComparison comparison>
+inline bool bases_match(char a, char b) {
+   if (comparison == COMPARE_EXACT) {
+      return a == b;
+   }
+   unsigned char folded_a = base_tables.fold[(unsigned char)a], folded_b = base_tables.fold[(unsigned char)b];
+   return folded_a == folded_b || (comparison == COMPARE_IUPAC && (base_tables.codes[folded_a] & base_tables.codes[folded_b]) != 0);
+}
+ 
+//Bitmasks of the byte comparisons of 64 alignment columns:
+struct ColumnComparisons {
+   uint64_t true_equal; //True haplotypes agree
+   uint64_t true_gap; //Either true haplotype has a gap
+   uint64_t test_equal; //Test haplotypes agree
+   uint64_t test_one_gap, test_two_gap;
+   uint64_t test_one_true_one, test_one_true_two; //Test haplotype 1 matches true haplotype 1/2
+   uint64_t test_two_true_one, test_two_true_two;
+};
+ 
+//Each operation set provides a bitmask of the bytes of a 64 byte block equal
+// to a character, the comparisons of 64 columns of the four records (and the
+// bitmask of those where all four are identical), and the compression of the
+// bits of a word selected by a mask (PEXT):
+//The scalar operations work on 8 bytes at a time within a 64-bit word (SWAR),
+// taking a bit for each zero byte of the XOR of two words:
+inline uint64_t zero_byte_bits8(uint64_t x) {
+   uint64_t high_bits = ~((((x & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | x)) & 0x8080808080808080ULL;
+   return ((high_bits >> 7) * 0x0102040810204080ULL) >> 56;
+}
+ 
+inline uint64_t load_word(const char *bytes) {
+   uint64_t word;
+   memcpy(&word, bytes, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+   word = __builtin_bswap64(word);
+#endif
+   return word;
+}
+ 
+//Gather the bits of x selected by mask into the low bits, in order (the
+// parallel suffix method from Hacker's Delight, for CPUs without BMI2 PEXT):
+inline uint64_t compress_bits_portable(uint64_t x, uint64_t mask) {
+   x &= mask;
+   uint64_t mask_zeros = ~mask << 1; //Counts the zeros of mask to the right of each bit
+   for (unsigned short int i = 0; i < 6; i++) {
+      uint64_t move = mask_zeros ^ (mask_zeros << 1);
+      move ^= move << 2;
+      move ^= move << 4;
+      move ^= move << 8;
+      move ^= move << 16;
+      move ^= move << 32;
+      uint64_t mask_moves = move & mask;
+      mask = (mask ^ mask_moves) | (mask_moves >> (1 << i));
+      uint64_t x_moves = x & mask_moves;
+      x = (x ^ x_moves) | (x_moves >> (1 << i));
+      mask_zeros &= ~move;
+   }
+   return x;
+}
+ 
+struct ScalarOps {
+   static inline uint64_t byte_mask64(const char *block, char c) {
+      uint64_t needle = 0x0101010101010101ULL * (unsigned char)c;
+      uint64_t mask = 0;
+      for (unsigned short int i = 0; i < 64; i += 8) {
+         mask |= zero_byte_bits8(load_word(block+i) ^ needle) << i;
+      }
+      return mask;
+   }
+   //Outside the exact mode, the bytes are folded and their nucleotide sets
+   // looked up through the tables one at a time:
+   template <BaseComparison comparison>
+   static inline uint64_t load_bases(const char *bytes) {
+      if (comparison == COMPARE_EXACT) {
+         return load_word(bytes);
+      }
+      uint64_t word = 0;
+      for (unsigned short int k = 0; k < 8; k++) {
+         word |= (uint64_t)base_tables.fold[(unsigned char)bytes[k]] << (8*k);
+      }
+      return word;
+   }
+   template <BaseComparison comparison>
+   static inline uint64_t load_codes(const char *bytes) {
+      uint64_t word = 0;
+      for (unsigned short int k = 0; comparison == COMPARE_IUPAC && k < 8; k++) {
+         word |= (uint64_t)base_tables.codes[(unsigned char)bytes[k]] << (8*k);
+      }
+      return word;
+   }
+   template <BaseComparison comparison>
+   static inline uint64_t match_bits8(uint64_t a, uint64_t b, uint64_t a_codes, uint64_t b_codes) {
+      uint64_t bits = zero_byte_bits8(a ^ b);
+      if (comparison == COMPARE_IUPAC) {
+         bits |= ~zero_byte_bits8(a_codes & b_codes) & 0xff;
+      }
+      return bits;
+   }
+   //Bitmask of the columns where all four records have the same byte:
+   static inline uint64_t identical_columns64(const char *true_one, const char *true_two, const char *test_one, const char *test_two) {
+      uint64_t mask = 0;
+      for (unsigned short int i = 0; i < 64; i += 8) {
+         uint64_t t1 = load_word(true_one+i);
+         mask |= zero_byte_bits8((t1 ^ load_word(true_two+i)) | (t1 ^ load_word(test_one+i)) | (t1 ^ load_word(test_two+i))) << i;
+      }
+      return mask;
+   }
+   template <BaseComparison comparison>
+   static inline void compare_columns64(const char *true_one, const char *true_two, const char *test_one, const char *test_two, ColumnComparisons &cmp) {
+      uint64_t gap = 0x0101010101010101ULL * (unsigned char)'-';
+      memset(&cmp, 0, sizeof(cmp));
+      for (unsigned short int i = 0; i < 64; i += 8) {
+         uint64_t t1 = load_bases<comparison>(true_one+i), t2 = load_bases<comparison>(true_two+i),
+                  s1 = load_bases<comparison>(test_one+i), s2 = load_bases<comparison>(test_two+i);
+         uint64_t t1_codes = load_codes<comparison>(true_one+i), t2_codes = load_codes<comparison>(true_two+i),
+                  s1_codes = load_codes<comparison>(test_one+i), s2_codes = load_codes<comparison>(test_two+i);
+         cmp.true_equal |= match_bits8<comparison>(t1, t2, t1_codes, t2_codes) << i;
+         cmp.true_gap |= (zero_byte_bits8(t1 ^ gap) | zero_byte_bits8(t2 ^ gap)) << i;
+         cmp.test_equal |= match_bits8<comparison>(s1, s2, s1_codes, s2_codes) << i;
+         cmp.test_one_gap |= zero_byte_bits8(s1 ^ gap) << i;
+         cmp.test_two_gap |= zero_byte_bits8(s2 ^ gap) << i;
+         cmp.test_one_true_one |= match_bits8<comparison>(s1, t1, s1_codes, t1_codes) << i;
+         cmp.test_one_true_two |= match_bits8<comparison>(s1, t2, s1_codes, t2_codes) << i;
+         cmp.test_two_true_one |= match_bits8<comparison>(s2, t1, s2_codes, t1_codes) << i;
+         cmp.test_two_true_two |= match_bits8<comparison>(s2, t2, s2_codes, t2_codes) << i;
+      }
+   }
+   static inline uint64_t compress_bits(uint64_t x, uint64_t mask) {
+      return compress_bits_portable(x, mask);
+   }
+};
+ 
+#ifdef HAVE_SIMD_VARIANTS
+struct Sse42Ops {
+   static inline __attribute__((target("sse4.2,popcnt"))) uint64_t byte_mask64(const char *block, char c) {
+      __m128i needle = _mm_set1_epi8(c);
+      uint64_t mask = 0;
+      for (unsigned short int i = 0; i < 4; i++) {
+         mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(block+16*i)), needle)) << (16*i);
+      }
+      return mask;
+   }
+   //Lowercase letters are folded by subtracting 0x20 where the byte minus 'a'
+   // is at most 25 (unsigned), and the nucleotide sets of the uppercase
+   // letters are looked up with a shuffle on the low nibble from one of the
+   // two tables, selected by bit 4, then zeroed for anything but 0x40-0x5f:
+   template <BaseComparison comparison>
+   static inline __attribute__((target("sse4.2,popcnt"))) __m128i load_bases(const char *bytes) {
+      __m128i x = _mm_loadu_si128((const __m128i *)bytes);
+      if (comparison == COMPARE_EXACT) {
+         return x;
+      }
+      __m128i letter = _mm_sub_epi8(x, _mm_set1_epi8('a'));
+      __m128i lowercase = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(25)), letter);
+      return _mm_sub_epi8(x, _mm_and_si128(lowercase, _mm_set1_epi8(0x20)));
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("sse4.2,popcnt"))) __m128i base_codes(__m128i x) {
+      if (comparison != COMPARE_IUPAC) {
+         return _mm_setzero_si128();
+      }
+      __m128i nibble = _mm_and_si128(x, _mm_set1_epi8(0x0f));
+      __m128i codes = _mm_blendv_epi8(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)IUPAC_CODES), nibble),
+                                      _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(IUPAC_CODES+16)), nibble), _mm_slli_epi16(x, 3));
+      return _mm_and_si128(codes, _mm_cmpeq_epi8(_mm_and_si128(x, _mm_set1_epi8((char)0xe0)), _mm_set1_epi8(0x40)));
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("sse4.2,popcnt"))) uint64_t match_mask16(__m128i a, __m128i b, __m128i a_codes, __m128i b_codes) {
+      unsigned int mask = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+      if (comparison == COMPARE_IUPAC) {
+         mask |= ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(a_codes, b_codes), _mm_setzero_si128())) & 0xffff;
+      }
+      return mask;
+   }
+   static inline __attribute__((target("sse4.2,popcnt"))) uint64_t identical_columns64(const char *true_one, const char *true_two, const char *test_one, const char *test_two) {
+      uint64_t mask = 0;
+      for (unsigned short int i = 0; i < 64; i += 16) {
+         __m128i t1 = _mm_loadu_si128((const __m128i *)(true_one+i));
+         __m128i identical = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(t1, _mm_loadu_si128((const __m128i *)(true_two+i))),
+                                                         _mm_cmpeq_epi8(t1, _mm_loadu_si128((const __m128i *)(test_one+i)))),
+                                           _mm_cmpeq_epi8(t1, _mm_loadu_si128((const __m128i *)(test_two+i))));
+         mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(identical) << i;
+      }
+      return mask;
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("sse4.2,popcnt"))) void compare_columns64(const char *true_one, const char *true_two, const char *test_one, const char *test_two, ColumnComparisons &cmp) {
+      memset(&cmp, 0, sizeof(cmp));
+      __m128i gap = _mm_set1_epi8('-');
+      for (unsigned short int i = 0; i < 64; i += 16) {
+         __m128i t1 = load_bases<comparison>(true_one+i), t2 = load_bases<comparison>(true_two+i);
+         __m128i s1 = load_bases<comparison>(test_one+i), s2 = load_bases<comparison>(test_two+i);
+         __m128i t1_codes = base_codes<comparison>(t1), t2_codes = base_codes<comparison>(t2);
+         __m128i s1_codes = base_codes<comparison>(s1), s2_codes = base_codes<comparison>(s2);
+         cmp.true_equal |= match_mask16<comparison>(t1, t2, t1_codes, t2_codes) << i;
+         cmp.true_gap |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(t1, gap), _mm_cmpeq_epi8(t2, gap))) << i;
+         cmp.test_equal |= match_mask16<comparison>(s1, s2, s1_codes, s2_codes) << i;
+         cmp.test_one_gap |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(s1, gap)) << i;
+         cmp.test_two_gap |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(s2, gap)) << i;
+         cmp.test_one_true_one |= match_mask16<comparison>(s1, t1, s1_codes, t1_codes) << i;
+         cmp.test_one_true_two |= match_mask16<comparison>(s1, t2, s1_codes, t2_codes) << i;
+         cmp.test_two_true_one |= match_mask16<comparison>(s2, t1, s2_codes, t1_codes) << i;
+         cmp.test_two_true_two |= match_mask16<comparison>(s2, t2, s2_codes, t2_codes) << i;
+      }
+   }
+   static inline uint64_t compress_bits(uint64_t x, uint64_t mask) {
+      return compress_bits_portable(x, mask);
+   }
+};
+ 
+struct Avx2Ops {
+   static inline __attribute__((target("avx2,bmi2,popcnt"))) uint64_t byte_mask64(const char *block, char c) {
+      __m256i needle = _mm256_set1_epi8(c);
+      uint64_t low = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)block), needle));
+      uint64_t high = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(block+32)), needle));
+      return low | (high << 32);
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("avx2,bmi2,popcnt"))) __m256i load_bases(const char *bytes) {
+      __m256i x = _mm256_loadu_si256((const __m256i *)bytes);
+      if (comparison == COMPARE_EXACT) {
+         return x;
+      }
+      __m256i letter = _mm256_sub_epi8(x, _mm256_set1_epi8('a'));
+      __m256i lowercase = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(25)), letter);
+      return _mm256_sub_epi8(x, _mm256_and_si256(lowercase, _mm256_set1_epi8(0x20)));
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("avx2,bmi2,popcnt"))) __m256i base_codes(__m256i x) {
+      if (comparison != COMPARE_IUPAC) {
+         return _mm256_setzero_si256();
+      }
+      __m256i nibble = _mm256_and_si256(x, _mm256_set1_epi8(0x0f));
+      __m256i low_codes = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)IUPAC_CODES));
+      __m256i high_codes = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(IUPAC_CODES+16)));
+      __m256i codes = _mm256_blendv_epi8(_mm256_shuffle_epi8(low_codes, nibble), _mm256_shuffle_epi8(high_codes, nibble), _mm256_slli_epi16(x, 3));
+      return _mm256_and_si256(codes, _mm256_cmpeq_epi8(_mm256_and_si256(x, _mm256_set1_epi8((char)0xe0)), _mm256_set1_epi8(0x40)));
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("avx2,bmi2,popcnt"))) uint64_t match_mask32(__m256i a, __m256i b, __m256i a_codes, __m256i b_codes) {
+      uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+      if (comparison == COMPARE_IUPAC) {
+         mask |= ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(a_codes, b_codes), _mm256_setzero_si256()));
+      }
+      return mask;
+   }
+   static inline __attribute__((target("avx2,bmi2,popcnt"))) uint64_t identical_columns64(const char *true_one, const char *true_two, const char *test_one, const char *test_two) {
+      uint64_t mask = 0;
+      for (unsigned short int i = 0; i < 64; i += 32) {
+         __m256i t1 = _mm256_loadu_si256((const __m256i *)(true_one+i));
+         __m256i identical = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(t1, _mm256_loadu_si256((const __m256i *)(true_two+i))),
+                                                               _mm256_cmpeq_epi8(t1, _mm256_loadu_si256((const __m256i *)(test_one+i)))),
+                                              _mm256_cmpeq_epi8(t1, _mm256_loadu_si256((const __m256i *)(test_two+i))));
+         mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(identical) << i;
+      }
+      return mask;
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("avx2,bmi2,popcnt"))) void compare_columns64(const char *true_one, const char *true_two, const char *test_one, const char *test_two, ColumnComparisons &cmp) {
+      memset(&cmp, 0, sizeof(cmp));
+      __m256i gap = _mm256_set1_epi8('-');
+      for (unsigned short int i = 0; i < 64; i += 32) {
+         __m256i t1 = load_bases<comparison>(true_one+i), t2 = load_bases<comparison>(true_two+i);
+         __m256i s1 = load_bases<comparison>(test_one+i), s2 = load_bases<comparison>(test_two+i);
+         __m256i t1_codes = base_codes<comparison>(t1), t2_codes = base_codes<comparison>(t2);
+         __m256i s1_codes = base_codes<comparison>(s1), s2_codes = base_codes<comparison>(s2);
+         cmp.true_equal |= match_mask32<comparison>(t1, t2, t1_codes, t2_codes) << i;
+         cmp.true_gap |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(t1, gap), _mm256_cmpeq_epi8(t2, gap))) << i;
+         cmp.test_equal |= match_mask32<comparison>(s1, s2, s1_codes, s2_codes) << i;
+         cmp.test_one_gap |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(s1, gap)) << i;
+         cmp.test_two_gap |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(s2, gap)) << i;
+         cmp.test_one_true_one |= match_mask32<comparison>(s1, t1, s1_codes, t1_codes) << i;
+         cmp.test_one_true_two |= match_mask32<comparison>(s1, t2, s1_codes, t2_codes) << i;
+         cmp.test_two_true_one |= match_mask32<comparison>(s2, t1, s2_codes, t1_codes) << i;
+         cmp.test_two_true_two |= match_mask32<comparison>(s2, t2, s2_codes, t2_codes) << i;
+      }
+   }
+   static inline __attribute__((target("avx2,bmi2,popcnt"))) uint64_t compress_bits(uint64_t x, uint64_t mask) {
+      return _pext_u64(x, mask);
+   }
+};
+ 
+struct Avx512Ops {
+   static inline __attribute__((target("avx512bw,bmi2,popcnt"))) uint64_t byte_mask64(const char *block, char c) {
+      return _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((const void *)block), _mm512_set1_epi8(c));
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("avx512bw,bmi2,popcnt"))) __m512i load_bases(const char *bytes) {
+      __m512i x = _mm512_loadu_si512((const void *)bytes);
+      if (comparison == COMPARE_EXACT) {
+         return x;
+      }
+      __mmask64 lowercase = _mm512_cmple_epu8_mask(_mm512_sub_epi8(x, _mm512_set1_epi8('a')), _mm512_set1_epi8(25));
+      return _mm512_mask_sub_epi8(x, lowercase, x, _mm512_set1_epi8(0x20));
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("avx512bw,bmi2,popcnt"))) __m512i base_codes(__m512i x) {
+      if (comparison != COMPARE_IUPAC) {
+         return _mm512_setzero_si512();
+      }
+      __m512i nibble = _mm512_and_si512(x, _mm512_set1_epi8(0x0f));
+      __m512i low_codes = _mm512_mask_broadcast_i32x4(_mm512_setzero_si512(), (__mmask16)-1, _mm_loadu_si128((const __m128i *)IUPAC_CODES));
+      __m512i high_codes = _mm512_mask_broadcast_i32x4(_mm512_setzero_si512(), (__mmask16)-1, _mm_loadu_si128((const __m128i *)(IUPAC_CODES+16)));
+      __m512i codes = _mm512_mask_blend_epi8(_mm512_test_epi8_mask(x, _mm512_set1_epi8(0x10)), _mm512_shuffle_epi8(low_codes, nibble), _mm512_shuffle_epi8(high_codes, nibble));
+      return _mm512_maskz_mov_epi8(_mm512_cmpeq_epi8_mask(_mm512_and_si512(x, _mm512_set1_epi8((char)0xe0)), _mm512_set1_epi8(0x40)), codes);
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("avx512bw,bmi2,popcnt"))) uint64_t match_mask64(__m512i a, __m512i b, __m512i a_codes, __m512i b_codes) {
+      uint64_t mask = _mm512_cmpeq_epi8_mask(a, b);
+      if (comparison == COMPARE_IUPAC) {
+         mask |= _mm512_test_epi8_mask(a_codes, b_codes);
+      }
+      return mask;
+   }
+   static inline __attribute__((target("avx512bw,bmi2,popcnt"))) uint64_t identical_columns64(const char *true_one, const char *true_two, const char *test_one, const char *test_two) {
+      __m512i t1 = _mm512_loadu_si512((const void *)true_one);
+      __mmask64 identical = _mm512_cmpeq_epi8_mask(t1, _mm512_loadu_si512((const void *)true_two));
+      identical = _mm512_mask_cmpeq_epi8_mask(identical, t1, _mm512_loadu_si512((const void *)test_one));
+      return _mm512_mask_cmpeq_epi8_mask(identical, t1, _mm512_loadu_si512((const void *)test_two));
+   }
+   template <BaseComparison comparison>
+   static inline __attribute__((target("avx512bw,bmi2,popcnt"))) void compare_columns64(const char *true_one, const char *true_two, const char *test_one, const char *test_two, ColumnComparisons &cmp) {
+      __m512i t1 = load_bases<comparison>(true_one), t2 = load_bases<comparison>(true_two);
+      __m512i s1 = load_bases<comparison>(test_one), s2 = load_bases<comparison>(test_two);
+      __m512i t1_codes = base_codes<comparison>(t1), t2_codes = base_codes<comparison>(t2);
+      __m512i s1_codes = base_codes<comparison>(s1), s2_codes = base_codes<comparison>(s2);
+      __m512i gap = _mm512_set1_epi8('-');
+      cmp.true_equal = match_mask64<comparison>(t1, t2, t1_codes, t2_codes);
+      cmp.true_gap = _mm512_cmpeq_epi8_mask(t1, gap) | _mm512_cmpeq_epi8_mask(t2, gap);
+      cmp.test_equal = match_mask64<comparison>(s1, s2, s1_codes, s2_codes);
+      cmp.test_one_gap = _mm512_cmpeq_epi8_mask(s1, gap);
+      cmp.test_two_gap = _mm512_cmpeq_epi8_mask(s2, gap);
+      cmp.test_one_true_one = match_mask64<comparison>(s1, t1, s1_codes, t1_codes);
+      cmp.test_one_true_two = match_mask64<comparison>(s1, t2, s1_codes, t2_codes);
+      cmp.test_two_true_one = match_mask64<comparison>(s2, t1, s2_codes, t1_codes);
+      cmp.test_two_true_two = match_mask64<comparison>(s2, t2, s2_codes, t2_codes);
+   }
+   static inline __attribute__((target("avx512bw,bmi2,popcnt"))) uint64_t compress_bits(uint64_t x, uint64_t mask) {
+      return _pext_u64(x, mask);
+   }
+};
+#endif
+ 
+//Kernels of the selected variant:
+struct SimdKernels {
+   SimdLevel level;
+   BaseComparison comparison;
+   const char *(*find_newline)(const char *pos, const char *end);
+   const char *(*find_header)(const char *pos, const char *end, bool line_start, size_t &newlines);
+   size_t (*classify_columns)(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, SiteIndex &sites);
+   size_t (*count_columns)(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, HapEvalState &state);
+   //The lookup table classifiers for the columns left over by the kernels:
+   size_t (*classify_columns_table)(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, SiteIndex &sites);
+   size_t (*count_columns_table)(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, HapEvalState &state);
+   //The homozygous columns against a truth index, by the kernel and then the table:
+   size_t (*count_hom_columns)(const char *truth, const char *test_one, const char *test_two, size_t length, const uint64_t *site_masks, HapEvalState &state);
+   size_t (*count_hom_columns_table)(const char *truth, const char *test_one, const char *test_two, size_t length, const uint64_t *site_masks, HapEvalState &state);
+};
+ 
+SimdKernels simd_kernels; //Set by select_simd_kernels() at startup
+ 
+//FASTA tokenizer:
+//Newlines and header starts are found 64 bytes at a time from bitmasks of the
+// matching bytes.
+ 
+//Find the next newline at or after pos, returning end if there is none:
+template <class Ops>
+inline const char *find_newline_kernel(const char *pos, const char *end) {
+   while (end - pos >= 64) {
+      uint64_t newlines = Ops::byte_mask64(pos, '\n');
+      if (newlines != 0) {
+         return pos + __builtin_ctzll(newlines);
+      }
+      pos += 64;
+   }
+   while (pos < end && *pos != '\n') {
+      pos++;
+   }
+   return pos;
+}
+ 
+inline const char *find_newline(const char *pos, const char *end) {
+   return simd_kernels.find_newline(pos, end);
+}
+ 
+//Find the next header start (a '>' at the start of a line) at or after pos,
+// adding the number of newlines skipped over to newlines, and returning end
+// if there is none.  line_start indicates whether pos is at the start of a line:
+template <class Ops>
+inline const char *find_header_kernel(const char *pos, const char *end, bool line_start, size_t &newlines) {
+   uint64_t carry = line_start ? 1 : 0;
+   while (end - pos >= 64) {
+      uint64_t newline_mask = Ops::byte_mask64(pos, '\n');
+      uint64_t headers = Ops::byte_mask64(pos, '>') & ((newline_mask << 1) | carry);
+      if (headers != 0) {
+         unsigned int header = (unsigned int)__builtin_ctzll(headers);
+         newlines += __builtin_popcountll(newline_mask & ((1ULL << header) - 1));
+         return pos + header;
+      }
+      newlines += __builtin_popcountll(newline_mask);
+      carry = newline_mask >> 63;
+      pos += 64;
+   }
+   for (; pos < end; pos++) {
+      if (*pos == '>' && carry) {
+         return pos;
+      }
+      carry = *pos == '\n';
+      newlines += carry;
+   }
+   return end;
+}
+ 
+inline const char *find_header(const char *pos, const char *end, bool line_start, size_t &newlines) {
+   return simd_kernels.find_header(pos, end, line_start, newlines);
+}
+ 
+//Size of the buffer that short fixed-width lines are packed into:
+const size_t PACK_BUFFER_SIZE = 1 << 16;
+ 
+//Iterates over the newline-free segments of a record in a mapped alignment.
+//For records with fixed-width lines, line ends are computed rather than searched
+// for, and short lines are packed into a buffer with memcpy so that segments
+// are long; otherwise segments are read in place:
+class RecordCursor {
+   public:
+      //Cursors can start part way along records with fixed-width lines:
+      RecordCursor(const char *data, const AlignmentRecord &record, size_t start_column = 0) : pos(data + record.seq_start), end(data + record.seq_end), seg(pos), segment_length(0),
+                                                                                             line_bases(record.line_bases), line_skip(record.line_width - record.line_bases),
+                                                                                             line_remaining(record.line_bases), buffer(0) {
+         if (line_bases > 0) {
+            pos += start_column / line_bases * record.line_width + start_column % line_bases;
+            line_remaining = line_bases - start_column % line_bases;
+         }
+         if (line_bases > 0 && line_bases < PACK_BUFFER_SIZE && record.length > line_bases) {
+            buffer = new char[PACK_BUFFER_SIZE];
+         }
+         next_segment();
+      }
+      ~RecordCursor() { delete[] buffer; }
+      const char *segment() const { return seg; }
+      size_t available() const { return segment_length; }
+      void advance(size_t n) {
+         seg += n;
+         segment_length -= n;
+         if (segment_length == 0) {
+            next_segment();
+         }
+      }
+   private:
+      RecordCursor(const RecordCursor &);
+      RecordCursor &operator=(const RecordCursor &);
+      //Take up to max_bases from the current fixed-width line, moving past the
+      // line terminator once the line is used up:
+      size_t take_line_bases(size_t max_bases) {
+         if (line_remaining == 0) {
+            pos += min(line_skip, (size_t)(end - pos));
+            line_remaining = line_bases;
+         }
+         size_t bases = min(min(line_remaining, max_bases), (size_t)(end - pos));
+         line_remaining -= bases;
+         return bases;
+      }
+      void next_segment() {
+         if (buffer != 0) { //Pack short fixed-width lines
+            segment_length = 0;
+            while (segment_length < PACK_BUFFER_SIZE && pos < end) {
+               size_t bases = take_line_bases(PACK_BUFFER_SIZE - segment_length);
+               memcpy(buffer + segment_length, pos, bases);
+               segment_length += bases;
+               pos += bases;
+            }
+            seg = buffer;
+            return;
+         }
+         if (line_bases > 0) { //Long fixed-width lines are read in place
+            segment_length = pos < end ? take_line_bases(end - pos) : 0;
+         } else { //Otherwise search for the end of the line
+            while (pos < end && *pos == '\n') {
+               pos++;
+            }
+            segment_length = find_newline(pos, end) - pos;
+         }
+         seg = pos;
+         pos += segment_length;
+      }
+      const char *pos; //Next unread byte of the record
+      const char *end;
+      const char *seg;
+      size_t segment_length;
+      size_t line_bases;
+      size_t line_skip;
+      size_t line_remaining;
+      char *buffer;
+};
+ 
+//Size of the buffer used by each cursor (and the record scan) in streaming mode:
+const size_t STREAM_BUFFER_SIZE = 1 << 20;
+ 
+//Iterates over the newline-free segments of a record, reading the file
+// through a fixed-size buffer so memory use is independent of record length.
+//For records with fixed-width lines, the line terminators are squeezed out of
+// the buffer arithmetically after each read, leaving one contiguous segment.
+//Given a number of threads to inflate with, the file is gzipped, and the
+// cursor inflates its own stream of it through fixed-size buffers, from
+// the BGZF block holding the start of the record (or from the start of any
+// other gzip file), reading past everything before the record:
+class StreamCursor {
+   public:
+      StreamCursor(int fd, const AlignmentRecord &record, unsigned int inflate_threads = 0) : fd(fd), file_pos(record.seq_start), file_end(record.seq_end),
+                                                                                                buffer(new char[STREAM_BUFFER_SIZE]), pos(buffer), end(buffer),
+                                                                                                segment_length(0), read_error(false), line_bases(record.line_bases),
+                                                                                                line_skip(record.line_width - record.line_bases),
+                                                                                                line_remaining(record.line_bases), skip_remaining(line_skip),
+                                                                                                input(0), input_failed(false) {
+         if (inflate_threads > 0) {
+            input = new SequentialInput(fd, inflate_threads, STREAM_BUFFER_SIZE, (off_t)record.bgzf_offset);
+            input_failed = !input->skip(record.seq_start - record.bgzf_start);
+         }
+         next_segment();
+      }
+      ~StreamCursor() {
+         delete[] buffer;
+         delete input;
+      }
+      const char *segment() const { return pos; }
+      size_t available() const { return segment_length; }
+      bool error() const { return read_error; }
+      void advance(size_t n) {
+         pos += n;
+         segment_length -= n;
+         if (segment_length == 0) {
+            next_segment();
+         }
+      }
+   private:
+      StreamCursor(const StreamCursor &);
+      StreamCursor &operator=(const StreamCursor &);
+      //Remove the line terminators of fixed-width lines from the buffer in place:
+      char *squeeze_lines(char *raw, char *raw_end) {
+         char *packed = raw;
+         while (raw < raw_end) {
+            if (line_remaining == 0) {
+               size_t skip = min(skip_remaining, (size_t)(raw_end - raw));
+               raw += skip;
+               skip_remaining -= skip;
+               if (skip_remaining == 0) {
+                  line_remaining = line_bases;
+                  skip_remaining = line_skip;
+               }
+               continue;
+            }
+            size_t bases = min(line_remaining, (size_t)(raw_end - raw));
+            memmove(packed, raw, bases);
+            packed += bases;
+            raw += bases;
+            line_remaining -= bases;
+         }
+         return packed;
+      }
+      void next_segment() {
+         while (true) {
+            while (line_bases == 0 && pos < end && *pos == '\n') {
+               pos++;
+            }
+            if (pos < end) {
+               break;
+            }
+            //Buffer exhausted, so refill it from the current file position:
+            size_t to_read = min(STREAM_BUFFER_SIZE, file_end - file_pos);
+            ssize_t bytes_read = to_read > 0 ? read_bytes(to_read) : 0;
+            if (bytes_read <= 0) {
+               read_error = bytes_read < 0 || to_read > 0;
+               pos = end = buffer;
+               segment_length = 0;
+               return;
+            }
+            file_pos += (size_t)bytes_read;
+            pos = buffer;
+            end = line_bases > 0 ? squeeze_lines(buffer, buffer + bytes_read) : buffer + bytes_read;
+         }
+         segment_length = line_bases > 0 ? end - pos : find_newline(pos, end) - pos;
+      }
+      ssize_t read_bytes(size_t to_read) {
+         if (input != 0) {
+            return input_failed ? -1 : input->read(buffer, to_read);
+         }
+         return pread(fd, buffer, to_read, (off_t)file_pos);
+      }
+      int fd;
+      size_t file_pos;
+      size_t file_end;
+      char *buffer;
+      const char *pos;
+      const char *end;
+      size_t segment_length;
+      bool read_error;
+      size_t line_bases;
+      size_t line_skip;
+      size_t line_remaining;
+      size_t skip_remaining;
+      SequentialInput *input; //Inflating the file, if it's gzipped
+      bool input_failed;
+};
+ 
+//Decide which of the records (if any) a header belongs to: the first ploidy
+// headers containing the true haplotype prefix are the true haplotypes, the
+// first ploidy others are the test haplotypes, and any further records are ignored.
+//The true haplotype records come first, then the test haplotype records, so
+// for two of each these are TRUE_ONE, TRUE_TWO, TEST_ONE and TEST_TWO:
+int assign_record(const string &header, const string &true_prefix, const AlignmentRecord *records, unsigned int ploidy = 2) {
+   unsigned int first = header.find(true_prefix) != string::npos ? 0 : ploidy;
+   for (unsigned int i = first; i < first + ploidy; i++) {
+      if (!records[i].found) {
+         return (int)i;
+      }
+   }
+   return -1;
+}
+ 
+//Find the contig a header belongs to: the part of the header matched by the
+// first parenthesised subexpression of the pattern, or by the whole pattern if
+// it has none.
+//Returns false if the header doesn't match the pattern:
+bool contig_name(const regex_t &pattern, const string &header, string &name) {
+   regmatch_t matches[2];
+   if (regexec(&pattern, header.c_str(), 2, matches, 0) != 0) {
+      return false;
+   }
+   const regmatch_t &match = matches[1].rm_so >= 0 ? matches[1] : matches[0];
+   name = header.substr(match.rm_so, match.rm_eo - match.rm_so);
+   return true;
+}
+ 
+//Locates the first two true haplotype records and the first two test haplotype
+// records from consecutive chunks of the alignment file, so the same scan
+// serves both an in-memory alignment and a streamed one.
+//Given a contig pattern, the records are instead grouped by contig, and the
+// four records of each contig are located, in the order the contigs first appear:
+class RecordLocator {
+   public:
+      RecordLocator(const string &true_prefix, AlignmentRecord *records, unsigned int ploidy = 2) : true_prefix(true_prefix), records(records), current(0),
+                                                                                                   records_found(0), offset(0), line_start(true), in_header(false),
+                                                                                                   ploidy(ploidy), contig_pattern(0), contigs(0), detect_widths(false),
+                                                                                                   line_length(0), line_bases(0), short_line(false), fixed_width(true) {}
+      RecordLocator(const string &true_prefix, const regex_t &contig_pattern, vector<ContigGroup> &contigs) : true_prefix(true_prefix), records(0), current(0),
+                                                                                                            records_found(0), offset(0), line_start(true), in_header(false),
+                                                                                                            ploidy(2), contig_pattern(&contig_pattern), contigs(&contigs),
+                                                                                                            detect_widths(false), line_length(0), line_bases(0), short_line(false),
+                                                                                                            fixed_width(true) {}
+      void consume(const char *chunk, size_t length) {
+         const char *pos = chunk;
+         const char *end = chunk + length;
+         while (pos < end) {
+            if (in_header) { //Header line
+               const char *newline = find_newline(pos, end);
+               header_buffer.append(pos, newline);
+               if (newline == end) {
+                  line_start = false;
+                  break;
+               }
+               start_record(offset + (newline + 1 - chunk));
+               line_start = true;
+               pos = newline + 1;
+               continue;
+            }
+            //Sequence lines, so skip straight to the next header, counting the
+            // newlines to get the record length:
+            size_t newlines = 0;
+            const char *header = find_header(pos, end, line_start, newlines);
+            if (current != 0) {
+               current->length += (header - pos) - newlines;
+               if (detect_widths) {
+                  track_lines(pos, header);
+               }
+            }
+            if (header == end) {
+               line_start = end[-1] == '\n';
+               break;
+            }
+            if (current != 0) {
+               current->seq_end = offset + (header - chunk);
+               end_record();
+            }
+            in_header = true;
+            header_buffer.clear();
+            pos = header + 1;
+         }
+         offset += length;
+      }
+      unsigned short int finish() {
+         if (in_header) { //Header on the last line without a trailing newline
+            start_record(offset);
+         }
+         if (current != 0) {
+            current->seq_end = offset;
+            if (detect_widths && line_length > 0) { //Last line without a trailing newline
+               end_line();
+            }
+            end_record();
+         }
+         return records_found;
+      }
+      //Also detect whether the lines of each located record have a fixed width,
+      // for when the records can't be checked in memory afterwards:
+      void detect_line_widths() { detect_widths = true; }
+   private:
+      //Follow the lengths of the lines of the current record, requiring (as
+      // samtools faidx does) every line but the last to be the same length:
+      void track_lines(const char *pos, const char *end) {
+         while (pos < end) {
+            const char *newline = find_newline(pos, end);
+            line_length += newline - pos;
+            if (newline == end) {
+               return;
+            }
+            end_line();
+            pos = newline + 1;
+         }
+      }
+      void end_line() {
+         if (line_length > 0 && (short_line || (line_bases > 0 && line_length > line_bases))) {
+            fixed_width = false;
+         }
+         if (line_bases == 0 && !short_line) {
+            line_bases = line_length;
+            short_line = line_length == 0;
+         } else if (line_length < line_bases) {
+            short_line = true;
+         }
+         line_length = 0;
+      }
+      void end_record() {
+         if (detect_widths && fixed_width && line_bases > 0) {
+            current->line_bases = line_bases;
+            current->line_width = line_bases + 1;
+         }
+         current = 0;
+      }
+      void start_record(size_t seq_start) {
+         in_header = false;
+         current = 0;
+         AlignmentRecord *group_records = records;
+         ContigGroup *contig = 0;
+         if (contig_pattern != 0) { //Any earlier record is complete, so growing the contigs can't leave current dangling
+            string name;
+            if (!contig_name(*contig_pattern, header_buffer, name)) {
+               return;
+            }
+            map<string, size_t>::iterator found_contig = contig_indices.find(name);
+            if (found_contig == contig_indices.end()) {
+               found_contig = contig_indices.insert(make_pair(name, contigs->size())).first;
+               contigs->push_back(ContigGroup());
+               contigs->back().name = name;
+            }
+            contig = &(*contigs)[found_contig->second];
+            group_records = contig->records;
+         }
+         int record_num = assign_record(header_buffer, true_prefix, group_records, ploidy);
+         current = record_num >= 0 ? &group_records[record_num] : 0;
+         line_length = 0;
+         line_bases = 0;
+         short_line = false;
+         fixed_width = true;
+         if (current != 0) {
+            current->header = header_buffer;
+            current->seq_start = seq_start;
+            current->seq_end = seq_start;
+            current->found = true;
+            records_found++;
+            if (contig != 0) {
+               contig->records_found++;
+            }
+         }
+      }
+      const string &true_prefix;
+      AlignmentRecord *records;
+      AlignmentRecord *current;
+      unsigned short int records_found;
+      size_t offset;
+      bool line_start;
+      bool in_header;
+      string header_buffer;
+      unsigned int ploidy;
+      const regex_t *contig_pattern;
+      vector<ContigGroup> *contigs;
+      map<string, size_t> contig_indices;
+      bool detect_widths;
+      size_t line_length;
+      size_t line_bases;
+      bool short_line;
+      bool fixed_width;
+};
+ 
+//A record of a samtools faidx (.fai) index, along with its full header line,
+// since the true haplotype prefix may fall after the first whitespace:
+struct FaiEntry {
+   string name;
+   string header;
+   size_t length, offset, line_bases, line_width;
+};
+ 
+//Read a .fai index, returning false if it can't be read or is malformed:
+bool read_fai(const string &index_file, vector<FaiEntry> &index) {
+   ifstream index_stream(index_file.c_str(), ios_base::in);
+   string line_buffer;
+   if (!index_stream) {
+      return false;
+   }
+   while (getline(index_stream, line_buffer)) {
+      if (line_buffer.empty()) {
+         continue;
+      }
+      FaiEntry entry;
+      size_t name_end = line_buffer.find('\t');
+      if (name_end == string::npos) {
+         return false;
+      }
+      entry.name = line_buffer.substr(0, name_end);
+      char *field_end;
+      const char *field = line_buffer.c_str() + name_end;
+      size_t *fields[4] = {&entry.length, &entry.offset, &entry.line_bases, &entry.line_width};
+      for (unsigned short int i = 0; i < 4; i++) {
+         *fields[i] = strtoull(field, &field_end, 10);
+         if (field_end == field) {
+            return false;
+         }
+         field = field_end;
+      }
+      index.push_back(entry);
+   }
+   return index_stream.eof();
+}
+ 
+//The index only holds the name of each record, so read its full header line
+// back from just before its sequence, either in memory or with pread if data is null.
+//Returns false if any record's sequence doesn't follow a header line:
+bool read_fai_headers(const char *data, int fd, size_t size, vector<FaiEntry> &index) {
+   string window;
+   for (size_t i = 0; i < index.size(); i++) {
+      if (index[i].offset == 0 || index[i].offset > size) {
+         return false;
+      }
+      size_t header_end = index[i].offset - 1; //The newline ending the header
+      for (size_t window_length = 256; ; window_length *= 2) {
+         size_t window_start = header_end > window_length ? header_end - window_length : 0;
+         window.resize(header_end - window_start);
+         if (data != 0) {
+            memcpy(&window[0], data + window_start, window.size());
+         } else {
+            for (size_t bytes_read = 0; bytes_read < window.size(); ) {
+               ssize_t read_length = pread(fd, &window[bytes_read], window.size() - bytes_read, window_start + bytes_read);
+               if (read_length <= 0) {
+                  return false;
+               }
+               bytes_read += read_length;
+            }
+         }
+         size_t line_start = window.rfind('\n');
+         if (line_start == string::npos && window_start > 0) { //Header starts further back
+            continue;
+         }
+         line_start = line_start == string::npos ? 0 : line_start + 1;
+         if (line_start >= window.size() || window[line_start] != '>') {
+            return false;
+         }
+         index[i].header = window.substr(line_start + 1);
+         break;
+      }
+   }
+   return true;
+}
+ 
+//Write a .fai index:
+bool write_fai(const string &index_file, const vector<FaiEntry> &index) {
+   ofstream index_stream(index_file.c_str(), ios_base::out | ios_base::trunc);
+   for (size_t i = 0; i < index.size() && index_stream; i++) {
+      index_stream << index[i].name << '\t' << index[i].length << '\t' << index[i].offset << '\t'
+                   << index[i].line_bases << '\t' << index[i].line_width << '\n';
+   }
+   index_stream.close();
+   return !index_stream.fail();
+}
+ 
+//Returns true if the index exists and is at least as new as the alignment:
+bool fai_is_current(const string &index_file, const string &alignment_file) {
+   struct stat index_stat, alignment_stat;
+   if (stat(index_file.c_str(), &index_stat) != 0) {
+      return false;
+   }
+   if (stat(alignment_file.c_str(), &alignment_stat) == 0 && index_stat.st_mtime < alignment_stat.st_mtime) {
+      cerr << "Ignoring index " << index_file << " since it is older than the alignment." << endl;
+      return false;
+   }
+   return true;
+}
+ 
+//Builds a .fai index from consecutive chunks of the alignment file, following
+// samtools in requiring every line of a record but the last to be the same length:
+class FaiBuilder {
+   public:
+      FaiBuilder(vector<FaiEntry> &index) : index(index), offset(0), line_start(true), in_header(false), in_record(false),
+                                            line_length(0), short_line(false), consistent(true) {}
+      void consume(const char *chunk, size_t length) {
+         const char *pos = chunk;
+         const char *end = chunk + length;
+         while (pos < end) {
+            if (line_start) {
+               in_header = *pos == '>';
+               if (in_header) {
+                  end_record();
+                  header_buffer.clear();
+                  pos++;
+               }
+               line_start = false;
+            }
+            const char *newline = find_newline(pos, end);
+            if (in_header) {
+               header_buffer.append(pos, newline);
+            } else {
+               line_length += newline - pos;
+            }
+            if (newline == end) {
+               break;
+            }
+            end_line(offset + (newline + 1 - chunk));
+            pos = newline + 1;
+         }
+         offset += length;
+      }
+      //Returns false if any record has inconsistent line lengths:
+      bool finish() {
+         if (!line_start) { //Last line without a trailing newline
+            end_line(offset);
+         }
+         end_record();
+         return consistent;
+      }
+   private:
+      void end_line(size_t next_offset) {
+         line_start = true;
+         if (in_header) { //The record name is the header up to the first whitespace
+            in_record = true;
+            current.name = header_buffer.substr(0, header_buffer.find_first_of(" \t\r"));
+            current.header = header_buffer;
+            current.length = 0;
+            current.offset = next_offset;
+            current.line_bases = 0;
+            current.line_width = 0;
+            short_line = false;
+            return;
+         }
+         if (in_record) {
+            if (line_length > 0 && (short_line || (current.line_bases > 0 && line_length > current.line_bases))) {
+               consistent = false;
+            }
+            if (current.line_bases == 0 && !short_line) {
+               current.line_bases = line_length;
+               current.line_width = line_length + 1;
+               short_line = line_length == 0;
+            } else if (line_length < current.line_bases) {
+               short_line = true;
+            }
+            current.length += line_length;
+         }
+         line_length = 0;
+      }
+      void end_record() {
+         if (in_record) {
+            index.push_back(current);
+            in_record = false;
+         }
+      }
+      vector<FaiEntry> &index;
+      FaiEntry current;
+      size_t offset;
+      bool line_start;
+      bool in_header;
+      bool in_record;
+      string header_buffer;
+      size_t line_length;
+      bool short_line;
+      bool consistent;
+};
+ 
+//Locate the four records from a .fai index, returning the number found:
+unsigned short int select_indexed_records(const vector<FaiEntry> &index, const string &true_prefix, AlignmentRecord records[NUM_RECORDS]) {
+   unsigned short int records_found = 0;
+   for (size_t i = 0; i < index.size(); i++) {
+      int record_num = assign_record(index[i].header, true_prefix, records);
+      if (record_num < 0) {
+         continue;
+      }
+      AlignmentRecord &record = records[record_num];
+      record.header = index[i].header;
+      record.length = index[i].length;
+      record.seq_start = index[i].offset;
+      record.line_bases = index[i].line_bases;
+      record.line_width = index[i].line_width;
+      //Full lines, then the bases of the last partial line:
+      record.seq_end = record.seq_start;
+      if (record.line_bases > 0) {
+         record.seq_end += (record.length / record.line_bases) * record.line_width + record.length % record.line_bases;
+      }
+      record.found = true;
+      records_found++;
+   }
+   return records_found;
+}
+ 
+//Detect whether every line of an in-memory record but the last has the same
+// length, so that its line ends can be computed rather than searched for.
+//Checking one byte per line is enough: if each full line ends in a newline and
+// everything after the last partial line is a newline, the byte count leaves no
+// room for any other newlines.
+void detect_line_width(const char *data, AlignmentRecord &record) {
+   const char *start = data + record.seq_start;
+   const char *end = data + record.seq_end;
+   size_t line_bases = find_newline(start, end) - start;
+   if (line_bases == record.length && line_bases > 0) { //A single line is fixed-width too
+      record.line_bases = line_bases;
+      record.line_width = line_bases + 1;
+      return;
+   }
+   if (line_bases == 0 || line_bases > record.length) { //Blank first line
+      return;
+   }
+   size_t full_lines = record.length / line_bases;
+   for (size_t line = 0; line < full_lines; line++) {
+      if (start[line * (line_bases + 1) + line_bases] != '\n') {
+         return;
+      }
+   }
+   const char *tail = start + full_lines * (line_bases + 1) + record.length % line_bases;
+   if (tail > end) {
+      return;
+   }
+   for (; tail < end; tail++) {
+      if (*tail != '\n') {
+         return;
+      }
+   }
+   record.line_bases = line_bases;
+   record.line_width = line_bases + 1;
+}
+ 
+//Whether cursors can start part way along all four records, i.e. whether
+// they all have fixed-width lines (or are empty):
+bool records_seekable(const AlignmentRecord records[NUM_RECORDS]) {
+   for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+      if (records[i].line_bases == 0 && records[i].length > 0) {
+         return false;
+      }
+   }
+   return true;
+}
+ 
+//Locate the four records (or the ploidy true and test haplotype records) of an
+// in-memory alignment, detecting any fixed line widths, and returning the
+// number of records found:
+unsigned short int locate_records(const char *data, size_t size, const string &true_prefix, AlignmentRecord *records, unsigned int ploidy = 2) {
+   RecordLocator locator(true_prefix, records, ploidy);
+   locator.consume(data, size);
+   unsigned short int records_found = locator.finish();
+   for (unsigned short int i = 0; i < 2 * ploidy; i++) {
+      if (records[i].found) {
+         detect_line_width(data, records[i]);
+      }
+   }
+   return records_found;
+}
+ 
+//Locate the four records of each contig of an in-memory alignment, grouping
+// the records by contig_pattern and detecting any fixed line widths:
+void locate_contigs(const char *data, size_t size, const string &true_prefix, const regex_t &contig_pattern, vector<ContigGroup> &contigs) {
+   RecordLocator locator(true_prefix, contig_pattern, contigs);
+   locator.consume(data, size);
+   locator.finish();
+   for (size_t contig = 0; contig < contigs.size(); contig++) {
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         if (contigs[contig].records[i].found) {
+            detect_line_width(data, contigs[contig].records[i]);
+         }
+      }
+   }
+}
+ 
+//Check that all four records were found and are the same length, returning
+// 0 if so, otherwise the exit status for the problem:
+int check_records(unsigned short int records_found, const AlignmentRecord records[NUM_RECORDS]) {
+   if (records_found < NUM_RECORDS) {
+      return 8;
+   }
+   if (records[TRUE_TWO].length != records[TRUE_ONE].length ||
+       records[TEST_ONE].length != records[TRUE_ONE].length ||
+       records[TEST_TWO].length != records[TRUE_ONE].length) {
+      return 9;
+   }
+   return 0;
+}
+ 
+//Description of the error for an exit status:
+const char *status_message(int status) {
+   switch (status) {
+      case 0:
+         return "OK";
+      case 3:
+         return "Region must be given as start-end, the first and last columns counting from 1.";
+      case 5:
+         return "Unable to open input alignment file.";
+      case 7:
+         return "An error occurred while reading the input alignment file.";
+      case 8:
+         return "Input alignment must contain two true and two test haplotype records.";
+      case 9:
+         return "Alignment records differ in length.";
+      case 11:
+         return "Packed alignment cache is corrupt.";
+      case 12:
+         return "Input alignment must contain two test haplotype records.";
+      case 13:
+         return "Truth index is corrupt.";
+      case 14:
+         return "Input alignment must contain as many true and test haplotype records as the ploidy.";
+      default:
+         return "Unknown error.";
+   }
+}
+ 
+//Feed a file to a record locator or index builder through a fixed-size buffer:
+template <class Consumer>
+bool scan_alignment_file(int fd, Consumer &consumer) {
+   char *scan_buffer = new char[STREAM_BUFFER_SIZE];
+   ssize_t bytes_read;
+   off_t offset = 0;
+   while ((bytes_read = pread(fd, scan_buffer, STREAM_BUFFER_SIZE, offset)) > 0) {
+      consumer.consume(scan_buffer, (size_t)bytes_read);
+      offset += bytes_read;
+   }
+   delete[] scan_buffer;
+   return bytes_read == 0;
+}
+ 
+//Feed a gzipped file to a record locator, inflating it on inflate_threads
+// threads.  For BGZF input, note the block each record's sequence starts in
+// as the record is found, so its cursor can start inflating there:
+bool scan_compressed_alignment(int fd, unsigned int inflate_threads, RecordLocator &locator, AlignmentRecord records[NUM_RECORDS]) {
+   SequentialInput input(fd, inflate_threads, SEQUENTIAL_INPUT_SIZE, 0);
+   char *inflated_buffer = new char[STREAM_BUFFER_SIZE];
+   bool block_noted[NUM_RECORDS] = {false, false, false, false};
+   ssize_t inflated_length;
+   while ((inflated_length = input.read(inflated_buffer, STREAM_BUFFER_SIZE)) > 0) {
+      locator.consume(inflated_buffer, (size_t)inflated_length);
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         if (records[i].found && !block_noted[i]) { //Found in this buffer, so its block is still among the buffer's
+            block_noted[i] = true;
+            input.block_at(records[i].seq_start, records[i].bgzf_offset, records[i].bgzf_start);
+         }
+      }
+   }
+   delete[] inflated_buffer;
+   return inflated_length == 0;
+}
+ 
+//Column classification kernel:
+//Without position output, the columns are classified 64 at a time: each
+// record is compared with the others (and with the gap) using the selected
+// instruction set variant, giving one bitmask per comparison, and the
+// bitmasks of each class of column are combined from those with bitwise
+// operations, so that the counts come from popcounts rather than branches.
+ 
+//Bitmasks of the class of each of 64 columns:
+struct ColumnClasses {
+   uint64_t hom_match; //Homozygous, with no false indel or SNP
+   uint64_t false_indel_one, false_indel_two;
+   uint64_t false_snp_one, false_snp_two; //At homozygous sites or true indels
+   uint64_t het_snp;
+   uint64_t true_indel;
+   uint64_t bad_call_one, bad_call_two;
+   uint64_t test_one_true_one, test_one_true_two; //Het SNPs where test haplotype 1 has the allele of true haplotype 1/2
+   uint64_t test_two_true_one, test_two_true_two;
+};
+ 
+//Combine the comparisons into the column classes, following the same rules
+// as the per-column loop in evaluate_columns_scalar:
+inline void classify_columns64(const ColumnComparisons &cmp, ColumnClasses &classes) {
+   uint64_t hom = cmp.true_equal;
+   uint64_t test_gap = cmp.test_one_gap | cmp.test_two_gap;
+   classes.false_indel_one = hom & test_gap & ~cmp.test_one_gap;
+   classes.false_indel_two = hom & test_gap & ~cmp.test_two_gap;
+   uint64_t hom_mismatch = hom & ~test_gap & ~cmp.test_equal;
+   classes.hom_match = hom & ~test_gap & cmp.test_equal;
+   classes.het_snp = ~hom & ~cmp.true_gap;
+   classes.true_indel = ~hom & cmp.true_gap;
+   //At a het SNP, a test haplotype can only match both true haplotypes with an ambiguity
+   // code (in the IUPAC mode), which carries no phase:
+   classes.test_one_true_one = classes.het_snp & cmp.test_one_true_one & ~cmp.test_one_true_two;
+   classes.test_one_true_two = classes.het_snp & cmp.test_one_true_two & ~cmp.test_one_true_one;
+   classes.test_two_true_one = classes.het_snp & cmp.test_two_true_one & ~cmp.test_two_true_two;
+   classes.test_two_true_two = classes.het_snp & cmp.test_two_true_two & ~cmp.test_two_true_one;
+   classes.bad_call_one = classes.het_snp & ~cmp.test_one_true_one & ~cmp.test_one_true_two;
+   classes.bad_call_two = classes.het_snp & ~cmp.test_two_true_one & ~cmp.test_two_true_two;
+   //At a true indel, only the first test haplotype matching neither true haplotype counts:
+   uint64_t indel_test_one_mismatch = classes.true_indel & ~cmp.test_one_true_one & ~cmp.test_one_true_two;
+   uint64_t indel_test_two_mismatch = classes.true_indel & ~cmp.test_two_true_one & ~cmp.test_two_true_two & ~indel_test_one_mismatch;
+   classes.false_snp_one = (hom_mismatch & ~cmp.test_one_true_one) | indel_test_one_mismatch;
+   classes.false_snp_two = (hom_mismatch & cmp.test_one_true_one) | indel_test_two_mismatch;
+}
+ 
+//Count the phase switches of a test haplotype over 64 columns, given the het
+// SNPs where it has the allele of each true haplotype, updating its identity.
+//The identities are compressed to one bit per informative het SNP (set for
+// true haplotype 2), so each switch is a pair of adjacent bits that differ,
+// and only the identity at the last one carries over to the next 64 columns:
+template <class Ops>
+inline unsigned long int count_switches64(uint64_t true_one_allele, uint64_t true_two_allele, unsigned short int &id, unsigned short int &first_id) {
+   uint64_t informative = true_one_allele | true_two_allele;
+   if (informative == 0) {
+      return 0;
+   }
+   unsigned int informative_count = (unsigned int)__builtin_popcountll(informative);
+   uint64_t ids = Ops::compress_bits(true_two_allele, informative);
+   unsigned long int switches = __builtin_popcountll((ids ^ (ids >> 1)) & (((uint64_t)1 << (informative_count - 1)) - 1));
+   switches += id != 0 && id != (ids & 1) + 1;
+   first_id = id != 0 ? first_id : (unsigned short int)((ids & 1) + 1);
+   id = (unsigned short int)(((ids >> (informative_count - 1)) & 1) + 1);
+   return switches;
+}
+ 
+//Classify and count whole groups of 64 columns, returning the number of columns done:
+template <class Ops, BaseComparison comparison>
+inline size_t count_columns_kernel(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, HapEvalState &state) {
+   ColumnComparisons cmp;
+   ColumnClasses classes;
+   size_t i = 0;
+   for (; i + 64 <= length; i += 64) {
+      Ops::template compare_columns64<comparison>(true_one + i, true_two + i, test_one + i, test_two + i, cmp);
+      classify_columns64(cmp, classes);
+      state.test_one_switches += count_switches64<Ops>(classes.test_one_true_one, classes.test_one_true_two, state.test_one_id, state.test_one_first_id);
+      state.test_two_switches += count_switches64<Ops>(classes.test_two_true_one, classes.test_two_true_two, state.test_two_id, state.test_two_first_id);
+      state.test_one_false_snps += __builtin_popcountll(classes.false_snp_one);
+      state.test_two_false_snps += __builtin_popcountll(classes.false_snp_two);
+      state.test_one_false_indels += __builtin_popcountll(classes.false_indel_one);
+      state.test_two_false_indels += __builtin_popcountll(classes.false_indel_two);
+      state.test_one_bad_calls += __builtin_popcountll(classes.bad_call_one);
+      state.test_two_bad_calls += __builtin_popcountll(classes.bad_call_two);
+   }
+   return i;
+}
+ 
+//Append the columns of the set bits of a mask to a list of sites:
+inline void append_sites(uint64_t mask, size_t column, vector<uint64_t> &sites) {
+   while (mask != 0) {
+      sites.push_back(column + __builtin_ctzll(mask));
+      mask &= mask - 1;
+   }
+}
+ 
+//Count the homozygous column classes of whole groups of 64 columns, and index
+// the het SNP and true indel columns (numbered from offset) to be counted
+// separately, returning the number of columns done.
+//Groups where all four records are identical (most of them, in a typical
+// alignment) hold no events, so they are skipped after one cheap comparison,
+// which also gives the run statistics.
+//The counts are kept in locals, which the compiler can't otherwise keep in
+// registers across the appends to the index:
+template <class Ops, BaseComparison comparison>
+inline size_t classify_columns_kernel(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, SiteIndex &sites) {
+   ColumnComparisons cmp;
+   ColumnClasses classes;
+   unsigned long int test_one_false_snps = 0, test_two_false_snps = 0,
+                     test_one_false_indels = 0, test_two_false_indels = 0;
+   RunStats runs = state.runs;
+   size_t i = 0;
+   for (; i + 64 <= length; i += 64) {
+      uint64_t identical = Ops::identical_columns64(true_one + i, true_two + i, test_one + i, test_two + i);
+      runs.add(identical, 64);
+      if (identical == ~(uint64_t)0) {
+         runs.skipped_columns += 64;
+         continue;
+      }
+      Ops::template compare_columns64<comparison>(true_one + i, true_two + i, test_one + i, test_two + i, cmp);
+      classify_columns64(cmp, classes);
+      test_one_false_snps += __builtin_popcountll(classes.false_snp_one & cmp.true_equal);
+      test_two_false_snps += __builtin_popcountll(classes.false_snp_two & cmp.true_equal);
+      test_one_false_indels += __builtin_popcountll(classes.false_indel_one);
+      test_two_false_indels += __builtin_popcountll(classes.false_indel_two);
+      append_sites(classes.het_snp, offset + i, sites.het_snps);
+      append_sites(classes.true_indel, offset + i, sites.true_indels);
+   }
+   state.test_one_false_snps += test_one_false_snps;
+   state.test_two_false_snps += test_two_false_snps;
+   state.test_one_false_indels += test_one_false_indels;
+   state.test_two_false_indels += test_two_false_indels;
+   state.runs = runs;
+   return i;
+}
+ 
+//Count the homozygous columns of whole groups of 64 columns given just one
+// base of the true haplotypes there (as from a truth index), leaving out the
+// columns set in site_masks (one word per group), where the true haplotypes
+// differ and which are counted separately, and returning the number of
+// columns done:
+template <class Ops, BaseComparison comparison>
+inline size_t count_hom_columns_kernel(const char *truth, const char *test_one, const char *test_two, size_t length, const uint64_t *site_masks, HapEvalState &state) {
+   ColumnComparisons cmp;
+   ColumnClasses classes;
+   unsigned long int test_one_false_snps = 0, test_two_false_snps = 0,
+                     test_one_false_indels = 0, test_two_false_indels = 0;
+   RunStats runs = state.runs;
+   size_t i = 0;
+   for (; i + 64 <= length; i += 64) {
+      uint64_t hom = ~site_masks[i / 64];
+      uint64_t identical = Ops::identical_columns64(truth + i, truth + i, test_one + i, test_two + i) & hom;
+      runs.add(identical, 64);
+      if (identical == ~(uint64_t)0) {
+         runs.skipped_columns += 64;
+         continue;
+      }
+      Ops::template compare_columns64<comparison>(truth + i, truth + i, test_one + i, test_two + i, cmp);
+      cmp.true_equal = hom;
+      classify_columns64(cmp, classes);
+      test_one_false_snps += __builtin_popcountll(classes.false_snp_one & hom);
+      test_two_false_snps += __builtin_popcountll(classes.false_snp_two & hom);
+      test_one_false_indels += __builtin_popcountll(classes.false_indel_one);
+      test_two_false_indels += __builtin_popcountll(classes.false_indel_two);
+   }
+   state.test_one_false_snps += test_one_false_snps;
+   state.test_two_false_snps += test_two_false_snps;
+   state.test_one_false_indels += test_one_false_indels;
+   state.test_two_false_indels += test_two_false_indels;
+   state.runs = runs;
+   return i;
+}
+ 
+//Lookup table column classifier:
+//As a portable alternative to the bitmask kernels, each column is reduced to
+// the nine equality and gap tests the evaluation rules depend on, which index
+// a table of the column's events, so that a column takes one load rather
+// than a tree of branches that mispredict on real data.  Indexing by the tests
+// rather than by the bases keeps the result exact for any bytes.
+enum ColumnEvent {
+   FALSE_SNP_ONE = 1 << 0,
+   FALSE_SNP_TWO = 1 << 1,
+   FALSE_INDEL_ONE = 1 << 2,
+   FALSE_INDEL_TWO = 1 << 3,
+   BAD_CALL_ONE = 1 << 4,
+   BAD_CALL_TWO = 1 << 5,
+   TEST_ONE_ID_SHIFT = 6, //Identity (0 if not informative) of test haplotype 1 at a het SNP
+   TEST_TWO_ID_SHIFT = 8,
+   HET_SNP_SITE = 1 << 10,
+   TRUE_INDEL_SITE = 1 << 11
+};
+ 
+//Index of a column into the event table:
+template <BaseComparison comparison>
+inline unsigned int column_tests(char true_one, char true_two, char test_one, char test_two) {
+   return (unsigned int)bases_match<comparison>(true_one, true_two)
+          | (unsigned int)((true_one == '-') | (true_two == '-')) << 1
+          | (unsigned int)bases_match<comparison>(test_one, test_two) << 2
+          | (unsigned int)(test_one == '-') << 3
+          | (unsigned int)(test_two == '-') << 4
+          | (unsigned int)bases_match<comparison>(test_one, true_one) << 5
+          | (unsigned int)bases_match<comparison>(test_one, true_two) << 6
+          | (unsigned int)bases_match<comparison>(test_two, true_one) << 7
+          | (unsigned int)bases_match<comparison>(test_two, true_two) << 8;
+}
+ 
+//Events of each combination of column tests, worked out once with the same
+// rules as the bitmask kernels (combinations that can't occur are harmless):
+class ColumnEventTable {
+   public:
+      ColumnEventTable() {
+         for (unsigned int tests = 0; tests < (1 << 9); tests++) {
+            ColumnComparisons cmp;
+            ColumnClasses classes;
+            cmp.true_equal = tests & 1;
+            cmp.true_gap = (tests >> 1) & 1;
+            cmp.test_equal = (tests >> 2) & 1;
+            cmp.test_one_gap = (tests >> 3) & 1;
+            cmp.test_two_gap = (tests >> 4) & 1;
+            cmp.test_one_true_one = (tests >> 5) & 1;
+            cmp.test_one_true_two = (tests >> 6) & 1;
+            cmp.test_two_true_one = (tests >> 7) & 1;
+            cmp.test_two_true_two = (tests >> 8) & 1;
+            classify_columns64(cmp, classes);
+            events[tests] = (uint16_t)((classes.false_snp_one & 1) * FALSE_SNP_ONE | (classes.false_snp_two & 1) * FALSE_SNP_TWO
+                                       | (classes.false_indel_one & 1) * FALSE_INDEL_ONE | (classes.false_indel_two & 1) * FALSE_INDEL_TWO
+                                       | (classes.bad_call_one & 1) * BAD_CALL_ONE | (classes.bad_call_two & 1) * BAD_CALL_TWO
+                                       | ((classes.test_one_true_one & 1) + (classes.test_one_true_two & 1) * 2) << TEST_ONE_ID_SHIFT
+                                       | ((classes.test_two_true_one & 1) + (classes.test_two_true_two & 1) * 2) << TEST_TWO_ID_SHIFT
+                                       | (classes.het_snp & 1) * HET_SNP_SITE | (classes.true_indel & 1) * TRUE_INDEL_SITE);
+         }
+      }
+      uint16_t operator[](unsigned int tests) const { return events[tests]; }
+   private:
+      uint16_t events[1 << 9];
+};
+ 
+const ColumnEventTable column_events;
+ 
+//Update the phase of a test haplotype with its identity at a column (0 if the
+// column isn't an informative het SNP), without branching:
+inline void update_phase(unsigned short int column_id, unsigned short int &id, unsigned short int &first_id, unsigned long int &switches) {
+   switches += (column_id != 0) & (id != 0) & (column_id != id);
+   first_id = first_id != 0 ? first_id : column_id;
+   id = column_id != 0 ? column_id : id;
+}
+ 
+//Add the events of a column from the table to the counters and phase state:
+inline void count_column_events(unsigned int events, HapEvalState &state) {
+   state.test_one_false_snps += events & FALSE_SNP_ONE;
+   state.test_two_false_snps += (events & FALSE_SNP_TWO) >> 1;
+   state.test_one_false_indels += (events & FALSE_INDEL_ONE) >> 2;
+   state.test_two_false_indels += (events & FALSE_INDEL_TWO) >> 3;
+   state.test_one_bad_calls += (events & BAD_CALL_ONE) >> 4;
+   state.test_two_bad_calls += (events & BAD_CALL_TWO) >> 5;
+   update_phase((events >> TEST_ONE_ID_SHIFT) & 3, state.test_one_id, state.test_one_first_id, state.test_one_switches);
+   update_phase((events >> TEST_TWO_ID_SHIFT) & 3, state.test_two_id, state.test_two_first_id, state.test_two_switches);
+}
+ 
+//Classify and count columns with the event table, returning the number of columns done.
+//The state is copied into locals, which the compiler can't otherwise keep in
+// registers since the sequence bytes might alias it:
+template <BaseComparison comparison>
+size_t count_columns_table(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, HapEvalState &state) {
+   HapEvalState local = state;
+   for (size_t i = 0; i < length; i++) {
+      count_column_events(column_events[column_tests<comparison>(true_one[i], true_two[i], test_one[i], test_two[i])], local);
+   }
+   state = local;
+   return length;
+}
+ 
+//Count the homozygous columns with the event table, and index the het SNP and
+// true indel columns (numbered from offset) to be counted separately,
+// returning the number of columns done.
+//The sites of up to 64 columns at a time are collected in bitmasks, so the
+// loop has no branches for them to mispredict, and whole groups where all
+// four records are identical are skipped as in the kernels:
+template <BaseComparison comparison>
+size_t classify_columns_table(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, SiteIndex &sites) {
+   HapEvalState local = state;
+   for (size_t i = 0; i < length; i += 64) {
+      size_t group_length = min((size_t)64, length - i);
+      uint64_t het_snps = 0, true_indels = 0, identical = 0;
+      if (group_length == 64) {
+         identical = ScalarOps::identical_columns64(true_one + i, true_two + i, test_one + i, test_two + i);
+         if (identical == ~(uint64_t)0) {
+            local.runs.add(identical, 64);
+            local.runs.skipped_columns += 64;
+            continue;
+         }
+      } else {
+         for (size_t j = 0; j < group_length; j++) {
+            identical |= (uint64_t)((true_one[i+j] == true_two[i+j]) & (true_one[i+j] == test_one[i+j]) & (true_one[i+j] == test_two[i+j])) << j;
+         }
+      }
+      for (size_t j = 0; j < group_length; j++) {
+         unsigned int events = column_events[column_tests<comparison>(true_one[i+j], true_two[i+j], test_one[i+j], test_two[i+j])];
+         het_snps |= (uint64_t)((events & HET_SNP_SITE) != 0) << j;
+         true_indels |= (uint64_t)((events & TRUE_INDEL_SITE) != 0) << j;
+         //Only false SNPs and false indels occur at homozygous columns:
+         events = (events & (HET_SNP_SITE | TRUE_INDEL_SITE)) != 0 ? 0 : events;
+         local.test_one_false_snps += events & FALSE_SNP_ONE;
+         local.test_two_false_snps += (events & FALSE_SNP_TWO) >> 1;
+         local.test_one_false_indels += (events & FALSE_INDEL_ONE) >> 2;
+         local.test_two_false_indels += (events & FALSE_INDEL_TWO) >> 3;
+      }
+      local.runs.add(identical, (unsigned int)group_length);
+      append_sites(het_snps, offset + i, sites.het_snps);
+      append_sites(true_indels, offset + i, sites.true_indels);
+   }
+   state = local;
+   return length;
+}
+ 
+//Count the homozygous columns given one base of the true haplotypes with the
+// event table, leaving out the columns set in site_masks, returning the
+// number of columns done:
+template <BaseComparison comparison>
+size_t count_hom_columns_table(const char *truth, const char *test_one, const char *test_two, size_t length, const uint64_t *site_masks, HapEvalState &state) {
+   HapEvalState local = state;
+   for (size_t i = 0; i < length; i += 64) {
+      size_t group_length = min((size_t)64, length - i);
+      uint64_t sites = site_masks[i / 64];
+      if (group_length == 64) {
+         uint64_t identical = ScalarOps::identical_columns64(truth + i, truth + i, test_one + i, test_two + i) & ~sites;
+         if (identical == ~(uint64_t)0) {
+            local.runs.add(identical, 64);
+            local.runs.skipped_columns += 64;
+            continue;
+         }
+      }
+      uint64_t identical = 0;
+      for (size_t j = 0; j < group_length; j++) {
+         unsigned int events = column_events[column_tests<comparison>(truth[i+j], truth[i+j], test_one[i+j], test_two[i+j])];
+         identical |= (uint64_t)((truth[i+j] == test_one[i+j]) & (truth[i+j] == test_two[i+j])) << j;
+         events = (sites >> j) & 1 ? 0 : events;
+         local.test_one_false_snps += events & FALSE_SNP_ONE;
+         local.test_two_false_snps += (events & FALSE_SNP_TWO) >> 1;
+         local.test_one_false_indels += (events & FALSE_INDEL_ONE) >> 2;
+         local.test_two_false_indels += (events & FALSE_INDEL_TWO) >> 3;
+      }
+      local.runs.add(identical & ~sites, (unsigned int)group_length);
+   }
+   state = local;
+   return length;
+}
+ 
+//Gather the bytes of a list of sites of a block (given the block's first
+// column) into the four records of a buffer of stride columns:
+inline void gather_sites(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t offset,
+                         const uint64_t *sites, size_t num_sites, char *gathered, size_t stride) {
+   for (size_t k = 0; k < num_sites; k++) {
+      size_t i = sites[k] - offset;
+      gathered[k] = true_one[i];
+      gathered[stride + k] = true_two[i];
+      gathered[2 * stride + k] = test_one[i];
+      gathered[3 * stride + k] = test_two[i];
+   }
+}
+ 
+//Instantiations of the kernels for each variant, compiled for its instruction
+// set so that the operations are inlined into the loops:
+const char *find_newline_scalar(const char *pos, const char *end) {
+   return find_newline_kernel<ScalarOps>(pos, end);
+}
+const char *find_header_scalar(const char *pos, const char *end, bool line_start, size_t &newlines) {
+   return find_header_kernel<ScalarOps>(pos, end, line_start, newlines);
+}
+template <BaseComparison comparison>
+size_t classify_columns_scalar(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, SiteIndex &sites) {
+   return classify_columns_kernel<ScalarOps, comparison>(true_one, true_two, test_one, test_two, length, offset, state, sites);
+}
+template <BaseComparison comparison>
+size_t count_columns_scalar(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, HapEvalState &state) {
+   return count_columns_kernel<ScalarOps, comparison>(true_one, true_two, test_one, test_two, length, state);
+}
+template <BaseComparison comparison>
+size_t count_hom_columns_scalar(const char *truth, const char *test_one, const char *test_two, size_t length, const uint64_t *site_masks, HapEvalState &state) {
+   return count_hom_columns_kernel<ScalarOps, comparison>(truth, test_one, test_two, length, site_masks, state);
+}
+#ifdef HAVE_SIMD_VARIANTS
+__attribute__((target("sse4.2,popcnt"))) const char *find_newline_sse42(const char *pos, const char *end) {
+   return find_newline_kernel<Sse42Ops>(pos, end);
+}
+__attribute__((target("sse4.2,popcnt"))) const char *find_header_sse42(const char *pos, const char *end, bool line_start, size_t &newlines) {
+   return find_header_kernel<Sse42Ops>(pos, end, line_start, newlines);
+}
+template <BaseComparison comparison>
+__attribute__((target("sse4.2,popcnt"))) size_t classify_columns_sse42(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, SiteIndex &sites) {
+   return classify_columns_kernel<Sse42Ops, comparison>(true_one, true_two, test_one, test_two, length, offset, state, sites);
+}
+template <BaseComparison comparison>
+__attribute__((target("sse4.2,popcnt"))) size_t count_columns_sse42(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, HapEvalState &state) {
+   return count_columns_kernel<Sse42Ops, comparison>(true_one, true_two, test_one, test_two, length, state);
+}
+template <BaseComparison comparison>
+__attribute__((target("sse4.2,popcnt"))) size_t count_hom_columns_sse42(const char *truth, const char *test_one, const char *test_two, size_t length, const uint64_t *site_masks, HapEvalState &state) {
+   return count_hom_columns_kernel<Sse42Ops, comparison>(truth, test_one, test_two, length, site_masks, state);
+}
+__attribute__((target("avx2,bmi2,popcnt"))) const char *find_newline_avx2(const char *pos, const char *end) {
+   return find_newline_kernel<Avx2Ops>(pos, end);
+}
+__attribute__((target("avx2,bmi2,popcnt"))) const char *find_header_avx2(const char *pos, const char *end, bool line_start, size_t &newlines) {
+   return find_header_kernel<Avx2Ops>(pos, end, line_start, newlines);
+}
+template <BaseComparison comparison>
+__attribute__((target("avx2,bmi2,popcnt"))) size_t classify_columns_avx2(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, SiteIndex &sites) {
+   return classify_columns_kernel<Avx2Ops, comparison>(true_one, true_two, test_one, test_two, length, offset, state, sites);
+}
+template <BaseComparison comparison>
+__attribute__((target("avx2,bmi2,popcnt"))) size_t count_columns_avx2(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, HapEvalState &state) {
+   return count_columns_kernel<Avx2Ops, comparison>(true_one, true_two, test_one, test_two, length, state);
+}
+template <BaseComparison comparison>
+__attribute__((target("avx2,bmi2,popcnt"))) size_t count_hom_columns_avx2(const char *truth, const char *test_one, const char *test_two, size_t length, const uint64_t *site_masks, HapEvalState &state) {
+   return count_hom_columns_kernel<Avx2Ops, comparison>(truth, test_one, test_two, length, site_masks, state);
+}
+__attribute__((target("avx512bw,bmi2,popcnt"))) const char *find_newline_avx512bw(const char *pos, const char *end) {
+   return find_newline_kernel<Avx512Ops>(pos, end);
+}
+__attribute__((target("avx512bw,bmi2,popcnt"))) const char *find_header_avx512bw(const char *pos, const char *end, bool line_start, size_t &newlines) {
+   return find_header_kernel<Avx512Ops>(pos, end, line_start, newlines);
+}
+template <BaseComparison comparison>
+__attribute__((target("avx512bw,bmi2,popcnt"))) size_t classify_columns_avx512bw(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, SiteIndex &sites) {
+   return classify_columns_kernel<Avx512Ops, comparison>(true_one, true_two, test_one, test_two, length, offset, state, sites);
+}
+template <BaseComparison comparison>
+__attribute__((target("avx512bw,bmi2,popcnt"))) size_t count_columns_avx512bw(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, HapEvalState &state) {
+   return count_columns_kernel<Avx512Ops, comparison>(true_one, true_two, test_one, test_two, length, state);
+}
+template <BaseComparison comparison>
+__attribute__((target("avx512bw,bmi2,popcnt"))) size_t count_hom_columns_avx512bw(const char *truth, const char *test_one, const char *test_two, size_t length, const uint64_t *site_masks, HapEvalState &state) {
+   return count_hom_columns_kernel<Avx512Ops, comparison>(truth, test_one, test_two, length, site_masks, state);
+}
+#endif
+ 
+//Best instruction set variant supported by the CPU, from cpuid:
+SimdLevel detect_simd_level() {
+#ifdef HAVE_SIMD_VARIANTS
+   __builtin_cpu_init();
+   //The AVX2 and AVX-512BW variants also use BMI2, which all such CPUs have in practice:
+   bool bmi2 = __builtin_cpu_supports("bmi2");
+   if (__builtin_cpu_supports("avx512bw") && bmi2) {
+      return SIMD_AVX512BW;
+   }
+   if (__builtin_cpu_supports("avx2") && bmi2) {
+      return SIMD_AVX2;
+   }
+   if (__builtin_cpu_supports("sse4.2")) {
+      return SIMD_SSE42;
+   }
+#endif
+   return SIMD_SCALAR;
+}
+ 
+//Point the column kernels at the instantiations for a comparison mode:
+template <BaseComparison comparison>
+void select_column_kernels(SimdLevel level) {
+   simd_kernels.classify_columns_table = classify_columns_table<comparison>;
+   simd_kernels.count_columns_table = count_columns_table<comparison>;
+   simd_kernels.classify_columns = level == SIMD_TABLE ? classify_columns_table<comparison> : classify_columns_scalar<comparison>;
+   simd_kernels.count_columns = level == SIMD_TABLE ? count_columns_table<comparison> : count_columns_scalar<comparison>;
+   simd_kernels.count_hom_columns_table = count_hom_columns_table<comparison>;
+   simd_kernels.count_hom_columns = level == SIMD_TABLE ? count_hom_columns_table<comparison> : count_hom_columns_scalar<comparison>;
+#ifdef HAVE_SIMD_VARIANTS
+   if (level == SIMD_SSE42) {
+      simd_kernels.classify_columns = classify_columns_sse42<comparison>;
+      simd_kernels.count_columns = count_columns_sse42<comparison>;
+      simd_kernels.count_hom_columns = count_hom_columns_sse42<comparison>;
+   } else if (level == SIMD_AVX2) {
+      simd_kernels.classify_columns = classify_columns_avx2<comparison>;
+      simd_kernels.count_columns = count_columns_avx2<comparison>;
+      simd_kernels.count_hom_columns = count_hom_columns_avx2<comparison>;
+   } else if (level == SIMD_AVX512BW) {
+      simd_kernels.classify_columns = classify_columns_avx512bw<comparison>;
+      simd_kernels.count_columns = count_columns_avx512bw<comparison>;
+      simd_kernels.count_hom_columns = count_hom_columns_avx512bw<comparison>;
+   }
+#endif
+}
+ 
+//Point the kernels at an instruction set variant (which the CPU must support)
+// and a base comparison mode:
+void select_simd_kernels(SimdLevel level, BaseComparison comparison = COMPARE_EXACT) {
+   simd_kernels.level = level;
+   simd_kernels.comparison = comparison;
+   simd_kernels.find_newline = find_newline_scalar;
+   simd_kernels.find_header = find_header_scalar;
+#ifdef HAVE_SIMD_VARIANTS
+   if (level == SIMD_SSE42) {
+      simd_kernels.find_newline = find_newline_sse42;
+      simd_kernels.find_header = find_header_sse42;
+   } else if (level == SIMD_AVX2) {
+      simd_kernels.find_newline = find_newline_avx2;
+      simd_kernels.find_header = find_header_avx2;
+   } else if (level == SIMD_AVX512BW) {
+      simd_kernels.find_newline = find_newline_avx512bw;
+      simd_kernels.find_header = find_header_avx512bw;
+   }
+#endif
+   if (comparison == COMPARE_CASE) {
+      select_column_kernels<COMPARE_CASE>(level);
+   } else if (comparison == COMPARE_IUPAC) {
+      select_column_kernels<COMPARE_IUPAC>(level);
+   } else {
+      select_column_kernels<COMPARE_EXACT>(level);
+   }
+}
+ 
+//Event reporting:
+//The position of each event can be output as text (-o), or as binary records
+// (-e), or passed to a callback when embedding the evaluation.  The column
+// loop is a template on the reporting policy, so each mode compiles to a loop
+// of its own, and the summary-only path carries no reporting code at all.
+enum EventType {
+   EVENT_FALSE_INDEL_ONE = 0,
+   EVENT_FALSE_INDEL_TWO,
+   EVENT_FALSE_SNP_ONE,
+   EVENT_FALSE_SNP_TWO,
+   EVENT_SWITCH_ONE,
+   EVENT_SWITCH_TWO,
+   EVENT_BAD_CALL_ONE,
+   EVENT_BAD_CALL_TWO,
+   EVENT_TRUE_INDEL,
+   EVENT_INDEL_FALSE_SNP_ONE, //False SNP due to a test haplotype at a true indel
+   EVENT_INDEL_FALSE_SNP_TWO
+};
+ 
+const char *EVENT_MESSAGES[] = {"False indel at position ", "False indel at position ",
+                                "False SNP at position ", "False SNP at position ",
+                                "Test haplotype 1 switches at position ", "Test haplotype 2 switches at position ",
+                                "Test haplotype 1 doesn't match either true haplotype at position ",
+                                "Test haplotype 2 doesn't match either true haplotype at position ",
+                                "True indel at position ",
+                                "False SNP due to test haplotype 1 at position ", "False SNP due to test haplotype 2 at position "};
+ 
+//How the events of a run are reported:
+struct EventReporting {
+   enum Mode {NONE, TEXT, BINARY, CALLBACK} mode;
+   FILE *binary_output;
+   function<void(EventType, size_t)> callback;
+   EventReporting(Mode mode = NONE) : mode(mode), binary_output(0) {}
+   bool enabled() const { return mode != NONE; }
+};
+ 
+//Reporting policies, each reporting an event at a (1-based) position:
+struct NoEvents {
+   void report(EventType, size_t) {}
+};
+ 
+struct TextEvents {
+   void report(EventType event, size_t position) {
+      cout << EVENT_MESSAGES[event] << position << '\n';
+   }
+};
+ 
+//Binary events are one native 64-bit word each: the position shifted left by
+// 8 bits, with the EventType in the low 8 bits:
+struct BinaryEvents {
+   FILE *output;
+   BinaryEvents(FILE *output) : output(output) {}
+   void report(EventType event, size_t position) {
+      uint64_t record = (uint64_t)position << 8 | (uint64_t)event;
+      fwrite(&record, sizeof(record), 1, output);
+   }
+};
+ 
+struct CallbackEvents {
+   const function<void(EventType, size_t)> &callback;
+   CallbackEvents(const function<void(EventType, size_t)> &callback) : callback(callback) {}
+   void report(EventType event, size_t position) {
+      callback(event, position);
+   }
+};
+ 
+//Evaluate a block of alignment columns one at a time, updating the counters
+// and phase state, and reporting the position of each event:
+template <BaseComparison comparison, class Events>
+void evaluate_columns_scalar(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, Events &events) {
+   for (size_t i = 0; i < length; i++) {
+      if (bases_match<comparison>(true_one[i], true_two[i])) { //Homozygous site
+         if (test_one[i] == '-' || test_two[i] == '-') { //False indel
+            if (test_one[i] != '-') {
+               state.test_one_false_indels++;
+               events.report(EVENT_FALSE_INDEL_ONE, offset+i+1);
+            }
+            if (test_two[i] != '-') {
+               state.test_two_false_indels++;
+               events.report(EVENT_FALSE_INDEL_TWO, offset+i+1);
+            }
+         } else if (!bases_match<comparison>(test_one[i], test_two[i])) {
+            if (!bases_match<comparison>(test_one[i], true_one[i])) { //False SNP
+               state.test_one_false_snps++;
+               events.report(EVENT_FALSE_SNP_ONE, offset+i+1);
+            } else {
+               state.test_two_false_snps++;
+               events.report(EVENT_FALSE_SNP_TWO, offset+i+1);
+            }
+         }
+      } else { //Heterozygous SNP or indel
+         bool test_one_true_one = bases_match<comparison>(test_one[i], true_one[i]), test_one_true_two = bases_match<comparison>(test_one[i], true_two[i]);
+         bool test_two_true_one = bases_match<comparison>(test_two[i], true_one[i]), test_two_true_two = bases_match<comparison>(test_two[i], true_two[i]);
+         if (true_one[i] != '-' && true_two[i] != '-') { //Heterozygous SNP
+            //Check the first test haplotype (an ambiguity code matching both alleles carries no phase):
+            if (test_one_true_one && !test_one_true_two) {
+               if (state.test_one_id == 2) { //Phase switch occurred
+                  state.test_one_switches++;
+                  events.report(EVENT_SWITCH_ONE, offset+i+1);
+               } else if (state.test_one_id == 0) { //First informative het SNP
+                  state.test_one_first_id = 1;
+               }
+               state.test_one_id = 1;
+            } else if (test_one_true_two && !test_one_true_one) {
+               if (state.test_one_id == 1) { //Phase switch occurred
+                  state.test_one_switches++;
+                  events.report(EVENT_SWITCH_ONE, offset+i+1);
+               } else if (state.test_one_id == 0) { //First informative het SNP
+                  state.test_one_first_id = 2;
+               }
+               state.test_one_id = 2;
+            } else if (!test_one_true_one) {
+               state.test_one_bad_calls++;
+               events.report(EVENT_BAD_CALL_ONE, offset+i+1);
+            }
+            //Now check the second test haplotype:
+            if (test_two_true_one && !test_two_true_two) {
+               if (state.test_two_id == 2) { //Phase switch occurred
+                  state.test_two_switches++;
+                  events.report(EVENT_SWITCH_TWO, offset+i+1);
+               } else if (state.test_two_id == 0) { //First informative het SNP
+                  state.test_two_first_id = 1;
+               }
+               state.test_two_id = 1;
+            } else if (test_two_true_two && !test_two_true_one) {
+               if (state.test_two_id == 1) { //Phase switch occurred
+                  state.test_two_switches++;
+                  events.report(EVENT_SWITCH_TWO, offset+i+1);
+               } else if (state.test_two_id == 0) { //First informative het SNP
+                  state.test_two_first_id = 2;
+               }
+               state.test_two_id = 2;
+            } else if (!test_two_true_one) {
+               state.test_two_bad_calls++;
+               events.report(EVENT_BAD_CALL_TWO, offset+i+1);
+            }
+         } else { //Indel
+            //Not doing anything right now with indels
+            events.report(EVENT_TRUE_INDEL, offset+i+1);
+            if (!test_one_true_one && !test_one_true_two) {
+               state.test_one_false_snps++;
+               events.report(EVENT_INDEL_FALSE_SNP_ONE, offset+i+1);
+            } else if (!test_two_true_one && !test_two_true_two) {
+               state.test_two_false_snps++;
+               events.report(EVENT_INDEL_FALSE_SNP_TWO, offset+i+1);
+            }
+         }
+      }
+   }
+}
+ 
+//Evaluate a block of columns with the per-column loop for the comparison mode:
+template <class Events>
+void evaluate_columns_events(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, Events &events) {
+   if (simd_kernels.comparison == COMPARE_CASE) {
+      evaluate_columns_scalar<COMPARE_CASE>(true_one, true_two, test_one, test_two, length, offset, state, events);
+   } else if (simd_kernels.comparison == COMPARE_IUPAC) {
+      evaluate_columns_scalar<COMPARE_IUPAC>(true_one, true_two, test_one, test_two, length, offset, state, events);
+   } else {
+      evaluate_columns_scalar<COMPARE_EXACT>(true_one, true_two, test_one, test_two, length, offset, state, events);
+   }
+}
+ 
+//Columns classified before their sites are gathered, few enough that the
+// sites' bytes are still in the L2 cache by then:
+const size_t SITE_SLICE_COLUMNS = 1 << 14;
+ 
+//Evaluate a block of alignment columns, updating the counters and phase state.
+//When events are reported, the per-column loop specialized for the reporting
+// mode is used.  Otherwise each slice of the block is classified (whole
+// groups of 64 columns by the classification kernel, and the rest through the
+// lookup table), which counts the homozygous columns and indexes the het SNPs
+// and true indels.  Just the bytes of those sites are then gathered into
+// contiguous columns, where the switches, bad calls and false SNPs at indels
+// are counted by the same kernels, with 64 sites rather than 64 columns per
+// step:
+void evaluate_columns(const char *true_one, const char *true_two, const char *test_one, const char *test_two, size_t length, size_t offset, HapEvalState &state, const EventReporting &reporting) {
+   if (reporting.mode == EventReporting::TEXT) {
+      TextEvents events;
+      evaluate_columns_events(true_one, true_two, test_one, test_two, length, offset, state, events);
+      return;
+   } else if (reporting.mode == EventReporting::BINARY) {
+      BinaryEvents events(reporting.binary_output);
+      evaluate_columns_events(true_one, true_two, test_one, test_two, length, offset, state, events);
+      return;
+   } else if (reporting.mode == EventReporting::CALLBACK) {
+      CallbackEvents events(reporting.callback);
+      evaluate_columns_events(true_one, true_two, test_one, test_two, length, offset, state, events);
+      return;
+   }
+   SiteIndex &slice_sites = state.scratch.slice_sites;
+   SiteIndex &sites = state.sites != 0 ? *state.sites : slice_sites;
+   vector<char> &gathered = state.scratch.gathered;
+   size_t stride = min(SITE_SLICE_COLUMNS, length);
+   if (gathered.size() < NUM_RECORDS * stride) {
+      gathered.resize(NUM_RECORDS * stride);
+   }
+   for (size_t start = 0; start < length; start += SITE_SLICE_COLUMNS) {
+      size_t slice_length = min(SITE_SLICE_COLUMNS, length - start);
+      slice_sites.clear();
+      size_t first_het_snp = sites.het_snps.size();
+      size_t first_true_indel = sites.true_indels.size();
+      size_t i = simd_kernels.classify_columns(true_one + start, true_two + start, test_one + start, test_two + start, slice_length, offset + start, state, sites);
+      simd_kernels.classify_columns_table(true_one + start + i, true_two + start + i, test_one + start + i, test_two + start + i, slice_length - i, offset + start + i, state, sites);
+      //The het SNPs keep their order, so the switches are counted correctly, and the true indels follow (they don't affect the phase):
+      size_t num_het_snps = sites.het_snps.size() - first_het_snp;
+      size_t num_sites = num_het_snps + sites.true_indels.size() - first_true_indel;
+      gather_sites(true_one, true_two, test_one, test_two, offset, sites.het_snps.data() + first_het_snp, num_het_snps, &gathered[0], stride);
+      gather_sites(true_one, true_two, test_one, test_two, offset, sites.true_indels.data() + first_true_indel, num_sites - num_het_snps, &gathered[num_het_snps], stride);
+      const char *sites_true_one = &gathered[0], *sites_true_two = sites_true_one + stride,
+                 *sites_test_one = sites_true_two + stride, *sites_test_two = sites_test_one + stride;
+      i = simd_kernels.count_columns(sites_true_one, sites_true_two, sites_test_one, sites_test_two, num_sites, state);
+      simd_kernels.count_columns_table(sites_true_one + i, sites_true_two + i, sites_test_one + i, sites_test_two + i, num_sites - i, state);
+   }
+}
+ 
+//Evaluates an alignment read from a pipe, which can't be mapped or seeked.
+//The sequences of the first three of the four records to arrive are kept in
+// memory, and the columns of the last one are evaluated as soon as a slice of
+// them is read, so memory use is bounded by three records plus the read
+// buffer, and the evaluation keeps pace with whatever is writing into the pipe:
+class PipeEvaluator {
+   public:
+      PipeEvaluator(const string &true_prefix, HapEvalState &state, const EventReporting &reporting) : true_prefix(true_prefix), state(state),
+                                                                                                       reporting(reporting), current(-1), last_record(-1),
+                                                                                                       records_found(0), line_start(true), in_header(false),
+                                                                                                       length_mismatch(false) {}
+      void consume(const char *chunk, size_t length) {
+         const char *pos = chunk;
+         const char *end = chunk + length;
+         while (pos < end) {
+            if (in_header) { //Header line
+               const char *newline = find_newline(pos, end);
+               header_buffer.append(pos, newline);
+               if (newline == end) {
+                  line_start = false;
+                  break;
+               }
+               start_record();
+               line_start = true;
+               pos = newline + 1;
+               continue;
+            }
+            //Sequence lines up to the next header:
+            size_t newlines = 0;
+            const char *header = find_header(pos, end, line_start, newlines);
+            while (pos < header) {
+               const char *newline = find_newline(pos, header);
+               if (newline > pos) {
+                  take_sequence(pos, newline - pos);
+               }
+               pos = newline < header ? newline + 1 : header;
+            }
+            if (header == end) {
+               line_start = end[-1] == '\n';
+               break;
+            }
+            in_header = true;
+            header_buffer.clear();
+            pos = header + 1;
+         }
+      }
+      //Returns 0 once the whole alignment was evaluated, otherwise the exit status for the error:
+      int finish() {
+         if (in_header) { //Header on the last line without a trailing newline
+            start_record();
+         }
+         evaluate_pending();
+         if (records_found < NUM_RECORDS) {
+            return 8;
+         }
+         if (length_mismatch || records[last_record].length != sequences[(last_record + 1) % NUM_RECORDS].size()) {
+            return 9;
+         }
+         return 0;
+      }
+   private:
+      void start_record() {
+         in_header = false;
+         evaluate_pending();
+         if (current >= 0 && records_found < NUM_RECORDS) {
+            //Alignment records should all be the same length, so allocate the rest up front:
+            for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+               if (!records[i].found) {
+                  sequences[i].reserve(sequences[current].size());
+               }
+            }
+         }
+         current = assign_record(header_buffer, true_prefix, records);
+         if (current < 0) {
+            return;
+         }
+         records[current].header = header_buffer;
+         records[current].found = true;
+         records_found++;
+         if (records_found == NUM_RECORDS) { //The last record is evaluated as it arrives
+            last_record = current;
+            for (unsigned short int i = 1; i < NUM_RECORDS; i++) {
+               if (sequences[(current + i) % NUM_RECORDS].size() != sequences[(current + 1) % NUM_RECORDS].size()) {
+                  length_mismatch = true;
+               }
+            }
+         }
+      }
+      void take_sequence(const char *sequence, size_t length) {
+         if (current < 0) { //Ignored record
+            return;
+         }
+         if (records_found < NUM_RECORDS) {
+            sequences[current].append(sequence, length);
+            return;
+         }
+         size_t position = records[current].length;
+         if (length_mismatch || position + length > sequences[(current + 1) % NUM_RECORDS].size()) {
+            length_mismatch = true;
+            return;
+         }
+         //Lines are collected into slices, so the kernels see whole groups of 64 columns:
+         pending.append(sequence, length);
+         records[current].length += length;
+         if (pending.size() >= SITE_SLICE_COLUMNS) {
+            evaluate_pending();
+         }
+      }
+      void evaluate_pending() {
+         if (pending.empty() || length_mismatch) {
+            return;
+         }
+         size_t position = records[last_record].length - pending.size();
+         const char *columns[NUM_RECORDS];
+         for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+            columns[i] = (int)i == last_record ? pending.data() : sequences[i].data() + position;
+         }
+         evaluate_columns(columns[TRUE_ONE], columns[TRUE_TWO], columns[TEST_ONE], columns[TEST_TWO],
+                          pending.size(), position, state, reporting);
+         pending.clear();
+      }
+      const string &true_prefix;
+      HapEvalState &state;
+      const EventReporting &reporting;
+      AlignmentRecord records[NUM_RECORDS];
+      string sequences[NUM_RECORDS];
+      string pending; //Columns of the last record not yet evaluated
+      int current;
+      int last_record;
+      unsigned short int records_found;
+      bool line_start;
+      bool in_header;
+      bool length_mismatch;
+      string header_buffer;
+};
+ 
+//Iterate along the alignment with the four record cursors in lockstep, evaluating
+// the longest run of columns that is contiguous in all four records at a time.
+//offset is the column the cursors start at, for the positions output.
+//Returns false if any record ended early (e.g. due to a read error):
+template <class Cursor>
+bool evaluate_alignment(Cursor &true_one, Cursor &true_two, Cursor &test_one, Cursor &test_two, size_t length, HapEvalState &state, const EventReporting &reporting, size_t offset = 0) {
+   size_t position = 0;
+   while (position < length) {
+      size_t block_length = min(min(true_one.available(), true_two.available()),
+                                min(test_one.available(), test_two.available()));
+      if (block_length == 0) {
+         return false;
+      }
+      block_length = min(block_length, length - position);
+      evaluate_columns(true_one.segment(), true_two.segment(), test_one.segment(), test_two.segment(),
+                       block_length, offset + position, state, reporting);
+      true_one.advance(block_length);
+      true_two.advance(block_length);
+      test_one.advance(block_length);
+      test_two.advance(block_length);
+      position += block_length;
+   }
+   return true;
+}
+ 
+//Advance a cursor that can't seek by the given number of columns, a segment
+// at a time, returning false if its record ends first:
+template <class Cursor>
+bool skip_columns(Cursor &cursor, size_t columns) {
+   while (columns > 0) {
+      size_t skip = min(cursor.available(), columns);
+      if (skip == 0) {
+         return false;
+      }
+      cursor.advance(skip);
+      columns -= skip;
+   }
+   return true;
+}
+ 
+//Smallest number of columns worth handing to a thread of its own:
+const size_t PARALLEL_MIN_CHUNK_COLUMNS = 1 << 16;
+ 
+//Evaluate the length columns of an alignment from first_column on, split into
+// one chunk per thread, with evaluate_chunk(start, length, state) evaluating a
+// chunk into a state of its own, then merge the chunk states in order, which
+// gives exactly the result of evaluating the columns in one pass.
+//Returns false if any chunk ended early:
+template <class ChunkEvaluator>
+bool evaluate_chunks_parallel(const ChunkEvaluator &evaluate_chunk, size_t length, HapEvalState &state, unsigned int num_threads, size_t first_column = 0) {
+   size_t num_chunks = max((size_t)1, min((size_t)num_threads, length / PARALLEL_MIN_CHUNK_COLUMNS));
+   size_t chunk_length = ((length + num_chunks - 1) / num_chunks + 63) & ~(size_t)63; //Whole groups of 64 columns, covering all the columns
+   vector<HapEvalState> chunk_states(num_chunks);
+   vector<SiteIndex> chunk_sites(state.sites != 0 ? num_chunks : 0);
+   for (size_t chunk = 0; chunk < chunk_sites.size(); chunk++) {
+      chunk_states[chunk].sites = &chunk_sites[chunk];
+   }
+   vector<char> chunk_complete(num_chunks, 1);
+   vector<thread> workers;
+   for (size_t chunk = 1; chunk < num_chunks; chunk++) {
+      size_t start = min(length, chunk * chunk_length);
+      size_t end = min(length, start + chunk_length);
+      workers.push_back(thread([&, chunk, start, end]() {
+         chunk_complete[chunk] = evaluate_chunk(first_column + start, end - start, chunk_states[chunk]);
+      }));
+   }
+   chunk_complete[0] = evaluate_chunk(first_column, min(length, chunk_length), chunk_states[0]);
+   for (size_t i = 0; i < workers.size(); i++) {
+      workers[i].join();
+   }
+   for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+      if (!chunk_complete[chunk]) {
+         return false;
+      }
+      merge_states(state, chunk_states[chunk]);
+      if (state.sites != 0) {
+         state.sites->het_snps.insert(state.sites->het_snps.end(), chunk_sites[chunk].het_snps.begin(), chunk_sites[chunk].het_snps.end());
+         state.sites->true_indels.insert(state.sites->true_indels.end(), chunk_sites[chunk].true_indels.begin(), chunk_sites[chunk].true_indels.end());
+      }
+   }
+   return true;
+}
+ 
+//Lock-free single-producer/single-consumer queue with a fixed capacity:
+template <class T, size_t Capacity>
+class SpscQueue {
+   public:
+      SpscQueue() : head(0), tail(0) {}
+      void push(const T &item) {
+         size_t position = tail.load(memory_order_relaxed);
+         while (position - head.load(memory_order_acquire) == Capacity) { //Full
+            this_thread::yield();
+         }
+         items[position % Capacity] = item;
+         tail.store(position + 1, memory_order_release);
+      }
+      T pop() {
+         size_t position = head.load(memory_order_relaxed);
+         while (position == tail.load(memory_order_acquire)) { //Empty
+            this_thread::yield();
+         }
+         T item = items[position % Capacity];
+         head.store(position + 1, memory_order_release);
+         return item;
+      }
+   private:
+      T items[Capacity];
+      //Separate cache lines so the two threads don't contend over the indices:
+      alignas(64) atomic<size_t> head;
+      alignas(64) atomic<size_t> tail;
+};
+ 
+//Number of chunk buffers cycling between a reader thread and the evaluation:
+const size_t READ_AHEAD_CHUNKS = 4;
+ 
+//Number of columns of each record held by a read-ahead chunk:
+const size_t CHUNK_COLUMNS = 1 << 18;
+ 
+//Status of a chunk handed from the reader thread to the evaluation:
+enum ChunkStatus {
+   CHUNK_DATA, //More chunks follow
+   CHUNK_END, //Last chunk of the input
+   CHUNK_ERROR //Reading or inflating failed, so this chunk holds no data
+};
+ 
+//Raw bytes read from a pipe:
+struct ByteChunk {
+   char *data;
+   size_t length;
+   ChunkStatus status;
+   ByteChunk() : data(new char[STREAM_BUFFER_SIZE]), length(0), status(CHUNK_DATA) {}
+   ~ByteChunk() { delete[] data; }
+};
+ 
+//Newline-free columns of the four records:
+struct ColumnChunk {
+   char *columns[NUM_RECORDS];
+   size_t length;
+   ChunkStatus status;
+   ColumnChunk() : length(0), status(CHUNK_DATA) {
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         columns[i] = new char[CHUNK_COLUMNS];
+      }
+   }
+   ~ColumnChunk() {
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         delete[] columns[i];
+      }
+   }
+};
+ 
+//Cycles a fixed set of chunk buffers between a reader thread, which fills them
+// ahead of time, and the evaluation, which consumes them in order, so that
+// I/O overlaps with the evaluation:
+template <class Chunk>
+class ReadAhead {
+   public:
+      ReadAhead() {
+         for (size_t i = 0; i < READ_AHEAD_CHUNKS; i++) {
+            free_chunks.push(&chunks[i]);
+         }
+      }
+      //Reader thread side:
+      Chunk *acquire() { return free_chunks.pop(); }
+      void publish(Chunk *chunk) { filled_chunks.push(chunk); }
+      //Evaluation side:
+      Chunk *next() { return filled_chunks.pop(); }
+      void release(Chunk *chunk) { free_chunks.push(chunk); }
+   private:
+      Chunk chunks[READ_AHEAD_CHUNKS];
+      SpscQueue<Chunk *, READ_AHEAD_CHUNKS> free_chunks;
+      SpscQueue<Chunk *, READ_AHEAD_CHUNKS> filled_chunks;
+};
+ 
+//Evaluate the records with four stream cursors driven by a reader thread that
+// fills chunks of columns ahead of the evaluation.
+//Returns false if any record ended early (e.g. due to a read error):
+bool evaluate_alignment_read_ahead(int fd, const AlignmentRecord records[NUM_RECORDS], HapEvalState &state, const EventReporting &reporting,
+                                   unsigned int inflate_threads = 0) {
+   ReadAhead<ColumnChunk> chunks;
+   size_t length = records[TRUE_ONE].length;
+   thread reader([&]() {
+      StreamCursor true_one(fd, records[TRUE_ONE], inflate_threads), true_two(fd, records[TRUE_TWO], inflate_threads),
+                   test_one(fd, records[TEST_ONE], inflate_threads), test_two(fd, records[TEST_TWO], inflate_threads);
+      size_t position = 0;
+      ChunkStatus status = CHUNK_DATA;
+      while (status == CHUNK_DATA) {
+         ColumnChunk *chunk = chunks.acquire();
+         chunk->length = 0;
+         while (chunk->length < CHUNK_COLUMNS && position < length) {
+            size_t block_length = min(min(true_one.available(), true_two.available()),
+                                      min(test_one.available(), test_two.available()));
+            if (block_length == 0) {
+               status = CHUNK_ERROR;
+               break;
+            }
+            block_length = min(block_length, min(CHUNK_COLUMNS - chunk->length, length - position));
+            memcpy(chunk->columns[TRUE_ONE] + chunk->length, true_one.segment(), block_length);
+            memcpy(chunk->columns[TRUE_TWO] + chunk->length, true_two.segment(), block_length);
+            memcpy(chunk->columns[TEST_ONE] + chunk->length, test_one.segment(), block_length);
+            memcpy(chunk->columns[TEST_TWO] + chunk->length, test_two.segment(), block_length);
+            true_one.advance(block_length);
+            true_two.advance(block_length);
+            test_one.advance(block_length);
+            test_two.advance(block_length);
+            chunk->length += block_length;
+            position += block_length;
+         }
+         if (status == CHUNK_DATA && position == length) {
+            status = CHUNK_END;
+         }
+         chunk->status = status;
+         chunks.publish(chunk);
+      }
+   });
+   size_t position = 0;
+   ChunkStatus status = CHUNK_DATA;
+   while (status == CHUNK_DATA) {
+      ColumnChunk *chunk = chunks.next();
+      status = chunk->status;
+      if (status != CHUNK_ERROR) {
+         evaluate_columns(chunk->columns[TRUE_ONE], chunk->columns[TRUE_TWO], chunk->columns[TEST_ONE], chunk->columns[TEST_TWO],
+                          chunk->length, position, state, reporting);
+         position += chunk->length;
+      }
+      chunks.release(chunk);
+   }
+   reader.join();
+   return status == CHUNK_END;
+}
+ 
+//Feed a pipe (or any input read front to back) to the evaluator, inflating
+// it if it's gzipped, optionally with a reader thread filling chunks ahead of
+// the evaluation, so reading and inflating overlap with the evaluation:
+ChunkStatus read_pipe(int fd, PipeEvaluator &evaluator, bool read_ahead, unsigned int num_threads) {
+   ReadAhead<ByteChunk> chunks;
+   SequentialInput input(fd, num_threads);
+   auto read_chunk = [&](ByteChunk *chunk) {
+      ssize_t bytes_read = input.read(chunk->data, STREAM_BUFFER_SIZE);
+      chunk->length = bytes_read > 0 ? (size_t)bytes_read : 0;
+      if (bytes_read < 0) {
+         chunk->status = CHUNK_ERROR;
+      } else {
+         chunk->status = bytes_read == 0 ? CHUNK_END : CHUNK_DATA;
+      }
+   };
+   thread reader;
+   if (read_ahead) {
+      reader = thread([&]() {
+         ChunkStatus status = CHUNK_DATA;
+         while (status == CHUNK_DATA) {
+            ByteChunk *chunk = chunks.acquire();
+            read_chunk(chunk);
+            status = chunk->status;
+            chunks.publish(chunk);
+         }
+      });
+   }
+   ChunkStatus status = CHUNK_DATA;
+   while (status == CHUNK_DATA) {
+      ByteChunk *chunk = read_ahead ? chunks.next() : chunks.acquire();
+      if (!read_ahead) {
+         read_chunk(chunk);
+      }
+      status = chunk->status;
+      if (status == CHUNK_DATA) {
+         evaluator.consume(chunk->data, chunk->length);
+      }
+      chunks.release(chunk);
+   }
+   if (read_ahead) {
+      reader.join();
+   }
+   return status;
+}
+ 
+//Packed alignment cache (.hsa):
+//The four records are stored as 4-bit codes, two columns per byte (low nibble
+// first), so that repeated evaluations can map the cache instead of parsing
+// the FASTA again.  Code 0 is a gap and code 1 is N, so either is flagged by
+// a code below 2.  Any byte without a code of its own is stored as the escape
+// code, with its column and value kept in a per-record exception table.
+//Layout (native byte order): the fixed header, the four record headers, then
+// each packed record, then each exception table (columns, then bytes), with
+// every section starting on a 64 byte boundary.
+//An interleaved cache (HSA_INTERLEAVED) instead stores the four records as a
+// single section of two bytes per column (true haplotypes, then test
+// haplotypes, first record of each pair in the low nibble), so evaluation
+// reads one sequential stream rather than four.
+const char HSA_MAGIC[8] = {'H', 'S', 'A', 'P', 'A', 'C', 'K', '1'};
+const char HSA_ALPHABET[16] = {'-', 'N', 'A', 'C', 'G', 'T', 'a', 'c', 'g', 't', 'n', '.', 'R', 'Y', '*', 0};
+const unsigned char HSA_ESCAPE = 15;
+const size_t HSA_ALIGNMENT = 64;
+const uint32_t HSA_INTERLEAVED = 1;
+ 
+struct HsaHeader {
+   char magic[8];
+   uint64_t length; //Columns per record
+   uint64_t exceptions[NUM_RECORDS]; //Escaped columns per record
+   uint32_t header_lengths[NUM_RECORDS];
+   uint32_t checksum; //CRC-32 of everything after the fixed header
+   uint32_t flags;
+};
+ 
+//Offsets of the sections of a packed alignment cache:
+struct HsaLayout {
+   size_t headers;
+   size_t packed[NUM_RECORDS];
+   size_t exception_columns[NUM_RECORDS];
+   size_t exception_bytes[NUM_RECORDS];
+   size_t size;
+};
+ 
+inline size_t hsa_align(size_t offset) {
+   return (offset + HSA_ALIGNMENT - 1) & ~(HSA_ALIGNMENT - 1);
+}
+ 
+HsaLayout hsa_layout(const HsaHeader &header) {
+   HsaLayout layout;
+   size_t offset = sizeof(HsaHeader);
+   layout.headers = offset;
+   for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+      offset += header.header_lengths[i];
+   }
+   if (header.flags & HSA_INTERLEAVED) {
+      offset = hsa_align(offset);
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         layout.packed[i] = offset;
+      }
+      offset += (size_t)header.length * 2;
+   } else {
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         offset = hsa_align(offset);
+         layout.packed[i] = offset;
+         offset += (size_t)(header.length + 1) / 2;
+      }
+   }
+   for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+      offset = hsa_align(offset);
+      layout.exception_columns[i] = offset;
+      offset += (size_t)header.exceptions[i] * sizeof(uint64_t);
+      layout.exception_bytes[i] = offset;
+      offset += (size_t)header.exceptions[i];
+   }
+   layout.size = offset;
+   return layout;
+}
+ 
+bool is_hsa(const char *data, size_t size) {
+   return size >= sizeof(HSA_MAGIC) && memcmp(data, HSA_MAGIC, sizeof(HSA_MAGIC)) == 0;
+}
+ 
+//CRC-32 of a buffer of any size (zlib takes 32-bit lengths):
+uLong crc32_buffer(uLong crc, const char *data, size_t size) {
+   while (size > 0) {
+      uInt block = (uInt)min(size, (size_t)1 << 30);
+      crc = crc32(crc, (const Bytef *)data, block);
+      data += block;
+      size -= block;
+   }
+   return crc;
+}
+ 
+//Writes a packed alignment cache (or truth index) sequentially, keeping the
+// running checksum of everything after the fixed header:
+class HsaWriter {
+   public:
+      HsaWriter(const string &path, size_t header_size = sizeof(HsaHeader)) : output(path.c_str(), ios_base::out | ios_base::binary | ios_base::trunc), header_size(header_size),
+                                                                              offset(0), crc(crc32(0L, Z_NULL, 0)) {}
+      bool good() const { return (bool)output; }
+      void write(const char *data, size_t size) {
+         output.write(data, (streamsize)size);
+         if (offset >= header_size) {
+            crc = crc32_buffer(crc, data, size);
+         }
+         offset += size;
+      }
+      void pad_to(size_t target) {
+         static const char zeros[HSA_ALIGNMENT] = {0};
+         while (offset < target) {
+            write(zeros, min(target - offset, HSA_ALIGNMENT));
+         }
+      }
+      //Rewrite the fixed header now that the checksum and exception counts are known:
+      template <class Header>
+      bool finish(Header &header) {
+         header.checksum = (uint32_t)crc;
+         output.seekp(0);
+         output.write((const char *)&header, sizeof(header));
+         output.close();
+         return !output.fail();
+      }
+   private:
+      ofstream output;
+      size_t header_size;
+      size_t offset;
+      uLong crc;
+};
+ 
+//Code of each byte, the escape code for those without one of their own:
+void hsa_codes(unsigned char codes[256]) {
+   memset(codes, HSA_ESCAPE, 256);
+   for (unsigned char code = 0; code < HSA_ESCAPE; code++) {
+      codes[(unsigned char)HSA_ALPHABET[code]] = code;
+   }
+}
+ 
+//Pack length columns of a record into its own section, two columns per byte,
+// collecting the escaped columns.
+//Returns false if the record ends early:
+bool write_packed_record(HsaWriter &writer, RecordCursor &cursor, size_t length, const unsigned char codes[256],
+                         vector<uint64_t> &exception_columns, vector<char> &exception_bytes) {
+   vector<char> packed(PACK_BUFFER_SIZE);
+   size_t column = 0;
+   size_t packed_bytes = 0;
+   while (column < length && cursor.available() > 0) {
+      size_t block_length = min(cursor.available(), length - column);
+      const char *segment = cursor.segment();
+      for (size_t j = 0; j < block_length; j++, column++) {
+         unsigned char code = codes[(unsigned char)segment[j]];
+         if (code == HSA_ESCAPE) {
+            exception_columns.push_back(column);
+            exception_bytes.push_back(segment[j]);
+         }
+         if (column % 2 == 0) {
+            packed[packed_bytes] = (char)code;
+         } else {
+            packed[packed_bytes++] |= (char)(code << 4);
+            if (packed_bytes == packed.size()) {
+               writer.write(&packed[0], packed_bytes);
+               packed_bytes = 0;
+            }
+         }
+      }
+      cursor.advance(block_length);
+   }
+   if (column < length) {
+      return false;
+   }
+   if (column % 2 == 1) {
+      packed_bytes++;
+   }
+   writer.write(&packed[0], packed_bytes);
+   return true;
+}
+ 
+//Pack the four records of an alignment column by column into the single
+// interleaved section of a cache, two bytes per column.
+//Returns false if a record ends early:
+bool write_hsa_interleaved(HsaWriter &writer, const char *data, const AlignmentRecord records[NUM_RECORDS], size_t length, const unsigned char codes[256],
+                           vector<uint64_t> exception_columns[NUM_RECORDS], vector<char> exception_bytes[NUM_RECORDS]) {
+   RecordCursor true_one(data, records[TRUE_ONE]), true_two(data, records[TRUE_TWO]),
+                test_one(data, records[TEST_ONE]), test_two(data, records[TEST_TWO]);
+   RecordCursor *cursors[NUM_RECORDS] = {&true_one, &true_two, &test_one, &test_two};
+   vector<char> packed(PACK_BUFFER_SIZE);
+   size_t packed_bytes = 0;
+   size_t column = 0;
+   while (column < length) {
+      size_t block_length = length - column;
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         block_length = min(block_length, cursors[i]->available());
+      }
+      if (block_length == 0) {
+         return false;
+      }
+      block_length = min(block_length, (packed.size() - packed_bytes) / 2);
+      for (size_t j = 0; j < block_length; j++) {
+         unsigned char column_codes[NUM_RECORDS];
+         for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+            char base = cursors[i]->segment()[j];
+            column_codes[i] = codes[(unsigned char)base];
+            if (column_codes[i] == HSA_ESCAPE) {
+               exception_columns[i].push_back(column + j);
+               exception_bytes[i].push_back(base);
+            }
+         }
+         packed[packed_bytes++] = (char)(column_codes[TRUE_ONE] | column_codes[TRUE_TWO] << 4);
+         packed[packed_bytes++] = (char)(column_codes[TEST_ONE] | column_codes[TEST_TWO] << 4);
+      }
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         cursors[i]->advance(block_length);
+      }
+      column += block_length;
+      if (packed_bytes == packed.size()) {
+         writer.write(&packed[0], packed_bytes);
+         packed_bytes = 0;
+      }
+   }
+   writer.write(&packed[0], packed_bytes);
+   return true;
+}
+ 
+//Pack the four located records of an alignment into a cache file, one
+// section per record or, if interleaved, one section for all four:
+bool write_hsa(const string &path, const char *data, const AlignmentRecord records[NUM_RECORDS], bool interleaved) {
+   unsigned char codes[256];
+   hsa_codes(codes);
+   HsaHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, HSA_MAGIC, sizeof(HSA_MAGIC));
+   header.length = records[TRUE_ONE].length;
+   header.flags = interleaved ? HSA_INTERLEAVED : 0;
+   for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+      header.header_lengths[i] = (uint32_t)records[i].header.length();
+   }
+   HsaLayout layout = hsa_layout(header);
+   HsaWriter writer(path);
+   writer.write((const char *)&header, sizeof(header));
+   for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+      writer.write(records[i].header.data(), records[i].header.length());
+   }
+   vector<uint64_t> exception_columns[NUM_RECORDS];
+   vector<char> exception_bytes[NUM_RECORDS];
+   if (interleaved) {
+      writer.pad_to(layout.packed[TRUE_ONE]);
+      if (!write_hsa_interleaved(writer, data, records, (size_t)header.length, codes, exception_columns, exception_bytes)) {
+         return false;
+      }
+   } else {
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         writer.pad_to(layout.packed[i]);
+         RecordCursor cursor(data, records[i]);
+         if (!write_packed_record(writer, cursor, (size_t)header.length, codes, exception_columns[i], exception_bytes[i])) {
+            return false;
+         }
+      }
+   }
+   for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+      header.exceptions[i] = exception_columns[i].size();
+   }
+   layout = hsa_layout(header);
+   for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+      writer.pad_to(layout.exception_columns[i]);
+      if (!exception_columns[i].empty()) {
+         writer.write((const char *)&exception_columns[i][0], exception_columns[i].size() * sizeof(uint64_t));
+         writer.write(&exception_bytes[i][0], exception_bytes[i].size());
+      }
+   }
+   return writer.good() && writer.finish(header);
+}
+ 
+//Read-only view of a mapped packed alignment cache:
+class PackedAlignment {
+   public:
+      //Returns false if the cache is truncated, fails its checksum or has
+      // an unknown layout:
+      bool open(const char *data, size_t size) {
+         if (size < sizeof(HsaHeader)) {
+            return false;
+         }
+         memcpy(&header, data, sizeof(header));
+         if ((header.flags & ~HSA_INTERLEAVED) != 0) {
+            return false;
+         }
+         layout = hsa_layout(header);
+         if (layout.size != size || crc32_buffer(crc32(0L, Z_NULL, 0), data + sizeof(HsaHeader), size - sizeof(HsaHeader)) != header.checksum) {
+            return false;
+         }
+         base = data;
+         size_t offset = layout.headers;
+         for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+            headers[i].assign(data + offset, header.header_lengths[i]);
+            offset += header.header_lengths[i];
+         }
+         return true;
+      }
+      size_t length() const { return (size_t)header.length; }
+      bool interleaved() const { return (header.flags & HSA_INTERLEAVED) != 0; }
+      const string &record_header(unsigned short int record) const { return headers[record]; }
+      const unsigned char *packed(unsigned short int record) const { return (const unsigned char *)(base + layout.packed[record]); }
+      size_t exceptions(unsigned short int record) const { return (size_t)header.exceptions[record]; }
+      const uint64_t *exception_columns(unsigned short int record) const { return (const uint64_t *)(base + layout.exception_columns[record]); }
+      const char *exception_bytes(unsigned short int record) const { return base + layout.exception_bytes[record]; }
+   private:
+      HsaHeader header;
+      HsaLayout layout;
+      const char *base;
+      string headers[NUM_RECORDS];
+};
+ 
+//Iterates over a record of a packed alignment cache, decoding a buffer of
+// columns at a time, two per byte with a pair lookup table, and patching in
+// the escaped bytes:
+class PackedCursor {
+   public:
+      //Cursors can start part way along the record:
+      PackedCursor(const PackedAlignment &alignment, unsigned short int record, size_t start_column = 0) : PackedCursor(alignment.packed(record), alignment.length(),
+                                                                                                                         alignment.exception_columns(record),
+                                                                                                                         alignment.exception_bytes(record),
+                                                                                                                         alignment.exceptions(record), start_column) {}
+      //Or over any record packed the same way (as in a truth index):
+      PackedCursor(const unsigned char *record_packed, size_t record_length, const uint64_t *record_exception_columns, const char *record_exception_bytes,
+                   size_t exceptions, size_t start_column) : packed(record_packed), length(record_length), exception_columns(record_exception_columns),
+                                                             exception_bytes(record_exception_bytes), exceptions_left(exceptions), column(start_column & ~(size_t)1),
+                                                             buffer(new char[PACK_BUFFER_SIZE]), seg(buffer), segment_length(0) {
+         size_t skipped = lower_bound(exception_columns, exception_columns + exceptions_left, (uint64_t)column) - exception_columns;
+         exception_columns += skipped;
+         exception_bytes += skipped;
+         exceptions_left -= skipped;
+         for (unsigned int pair = 0; pair < 256; pair++) {
+            pairs[pair][0] = HSA_ALPHABET[pair & 15];
+            pairs[pair][1] = HSA_ALPHABET[pair >> 4];
+         }
+         next_segment();
+         if (start_column & 1) { //Decoding starts at the even column of the pair
+            advance(1);
+         }
+      }
+      ~PackedCursor() { delete[] buffer; }
+      const char *segment() const { return seg; }
+      size_t available() const { return segment_length; }
+      void advance(size_t n) {
+         seg += n;
+         segment_length -= n;
+         if (segment_length == 0) {
+            next_segment();
+         }
+      }
+   private:
+      PackedCursor(const PackedCursor &);
+      PackedCursor &operator=(const PackedCursor &);
+      //Decode the next buffer of columns (always starting on an even column):
+      void next_segment() {
+         size_t columns = min(PACK_BUFFER_SIZE & ~(size_t)1, length - column);
+         const unsigned char *source = packed + column / 2;
+         for (size_t j = 0; j < columns; j += 2) {
+            memcpy(buffer + j, pairs[source[j / 2]], 2);
+         }
+         while (exceptions_left > 0 && *exception_columns < column + columns) {
+            buffer[*exception_columns - column] = *exception_bytes;
+            exception_columns++;
+            exception_bytes++;
+            exceptions_left--;
+         }
+         seg = buffer;
+         segment_length = columns;
+         column += columns;
+      }
+      const unsigned char *packed;
+      size_t length;
+      const uint64_t *exception_columns;
+      const char *exception_bytes;
+      size_t exceptions_left;
+      size_t column;
+      char *buffer;
+      const char *seg;
+      size_t segment_length;
+      char pairs[256][2];
+};
+ 
+//Columns of each record decoded at a time from an interleaved cache, small
+// enough that the four decoded buffers stay in the L1 data cache:
+const size_t INTERLEAVED_BUFFER_COLUMNS = 1 << 12;
+ 
+//Iterates over the columns of an interleaved packed alignment cache, decoding
+// a buffer of columns of all four records at a time from the one stream of
+// column pairs, and patching in the escaped bytes of each record:
+class InterleavedPackedCursor {
+   public:
+      //Cursors can start at any column:
+      InterleavedPackedCursor(const PackedAlignment &alignment, size_t start_column = 0) : packed(alignment.packed(TRUE_ONE)), length(alignment.length()), column(start_column),
+                                                                                           buffer(new char[NUM_RECORDS * INTERLEAVED_BUFFER_COLUMNS]), offset(0),
+                                                                                           segment_length(0) {
+         for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+            exception_columns[i] = alignment.exception_columns(i);
+            exception_bytes[i] = alignment.exception_bytes(i);
+            exceptions_left[i] = alignment.exceptions(i);
+            size_t skipped = lower_bound(exception_columns[i], exception_columns[i] + exceptions_left[i], (uint64_t)start_column) - exception_columns[i];
+            exception_columns[i] += skipped;
+            exception_bytes[i] += skipped;
+            exceptions_left[i] -= skipped;
+         }
+         for (unsigned int pair = 0; pair < 256; pair++) {
+            pairs[pair][0] = HSA_ALPHABET[pair & 15];
+            pairs[pair][1] = HSA_ALPHABET[pair >> 4];
+         }
+         next_segment();
+      }
+      ~InterleavedPackedCursor() { delete[] buffer; }
+      const char *segment(unsigned short int record) const { return buffer + record * INTERLEAVED_BUFFER_COLUMNS + offset; }
+      size_t available() const { return segment_length; }
+      void advance(size_t n) {
+         offset += n;
+         segment_length -= n;
+         if (segment_length == 0) {
+            next_segment();
+         }
+      }
+   private:
+      InterleavedPackedCursor(const InterleavedPackedCursor &);
+      InterleavedPackedCursor &operator=(const InterleavedPackedCursor &);
+      void next_segment() {
+         size_t columns = min(INTERLEAVED_BUFFER_COLUMNS, length - column);
+         const unsigned char *source = packed + column * 2;
+         char *true_one = buffer + TRUE_ONE * INTERLEAVED_BUFFER_COLUMNS;
+         char *true_two = buffer + TRUE_TWO * INTERLEAVED_BUFFER_COLUMNS;
+         char *test_one = buffer + TEST_ONE * INTERLEAVED_BUFFER_COLUMNS;
+         char *test_two = buffer + TEST_TWO * INTERLEAVED_BUFFER_COLUMNS;
+         for (size_t j = 0; j < columns; j++) {
+            const char *true_pair = pairs[source[2 * j]];
+            const char *test_pair = pairs[source[2 * j + 1]];
+            true_one[j] = true_pair[0];
+            true_two[j] = true_pair[1];
+            test_one[j] = test_pair[0];
+            test_two[j] = test_pair[1];
+         }
+         for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+            char *record = buffer + i * INTERLEAVED_BUFFER_COLUMNS;
+            while (exceptions_left[i] > 0 && *exception_columns[i] < column + columns) {
+               record[*exception_columns[i] - column] = *exception_bytes[i];
+               exception_columns[i]++;
+               exception_bytes[i]++;
+               exceptions_left[i]--;
+            }
+         }
+         offset = 0;
+         segment_length = columns;
+         column += columns;
+      }
+      const unsigned char *packed;
+      size_t length;
+      const uint64_t *exception_columns[NUM_RECORDS];
+      const char *exception_bytes[NUM_RECORDS];
+      size_t exceptions_left[NUM_RECORDS];
+      size_t column;
+      char *buffer;
+      size_t offset;
+      size_t segment_length;
+      char pairs[256][2];
+};
+ 
+//Evaluate length columns of an interleaved packed alignment cache, starting
+// at column start.
+//Returns false if the cache ends early:
+bool evaluate_interleaved_alignment(const PackedAlignment &alignment, size_t start, size_t length, HapEvalState &state, const EventReporting &reporting) {
+   InterleavedPackedCursor cursor(alignment, start);
+   size_t position = 0;
+   while (position < length) {
+      size_t block_length = min(cursor.available(), length - position);
+      if (block_length == 0) {
+         return false;
+      }
+      evaluate_columns(cursor.segment(TRUE_ONE), cursor.segment(TRUE_TWO), cursor.segment(TEST_ONE), cursor.segment(TEST_TWO),
+                       block_length, start + position, state, reporting);
+      cursor.advance(block_length);
+      position += block_length;
+   }
+   return true;
+}
+ 
+//Evaluate the records of a packed alignment cache, over the given range of
+// columns if any, which must end within the alignment.
+//Returns 0 on success, otherwise the exit status for the error encountered:
+int evaluate_packed_alignment(const char *data, size_t size, HapEvalState &state, const EventReporting &reporting, unsigned int num_threads,
+                              ColumnRange *region = 0) {
+   PackedAlignment alignment;
+   ColumnRange all_columns;
+   if (!alignment.open(data, size)) {
+      return 11;
+   }
+   region = region != 0 ? region : &all_columns;
+   if (!region->clip(alignment.length())) {
+      return 3;
+   }
+   auto evaluate_chunk = [&](size_t start, size_t length, HapEvalState &chunk_state) {
+      if (alignment.interleaved()) {
+         return evaluate_interleaved_alignment(alignment, start, length, chunk_state, reporting);
+      }
+      PackedCursor true_one(alignment, TRUE_ONE, start), true_two(alignment, TRUE_TWO, start),
+                   test_one(alignment, TEST_ONE, start), test_two(alignment, TEST_TWO, start);
+      return evaluate_alignment(true_one, true_two, test_one, test_two, length, chunk_state, reporting, start);
+   };
+   if (num_threads > 1 && !reporting.enabled()) {
+      return evaluate_chunks_parallel(evaluate_chunk, region->length(), state, num_threads, region->start) ? 0 : 7;
+   }
+   return evaluate_chunk(region->start, region->length(), state) ? 0 : 7;
+}
+ 
+//Truth index (.hti):
+//The structure of the two true haplotypes, built once by the truth subcommand
+// and reused to evaluate any number of pairs of test haplotypes against them,
+// so that only the test haplotypes are read, and the true haplotypes aren't
+// classified again.  The bases of the first true haplotype are packed as in
+// a cache (these are the bases of both wherever the two are the same), and
+// the sorted columns where the two true haplotypes differ at all (the het
+// SNPs and true indels, and any columns that only match with -c) are listed
+// with both their bytes, so the index serves every comparison mode.
+//Layout (native byte order): the fixed header, the true haplotype prefix and
+// the two true record headers, then the packed bases, their exception table
+// (columns, then bytes), the site columns and the site bytes (true haplotype
+// 1, then 2, for each site), with every section starting on a 64 byte
+// boundary.
+const char HTI_MAGIC[8] = {'H', 'S', 'A', 'T', 'R', 'U', 'T', 'H'};
+ 
+struct HtiHeader {
+   char magic[8];
+   uint64_t length; //Columns
+   uint64_t exceptions; //Escaped columns of the packed bases
+   uint64_t sites; //Columns where the true haplotypes differ
+   uint32_t prefix_length;
+   uint32_t header_lengths[2];
+   uint32_t checksum; //CRC-32 of everything after the fixed header
+};
+ 
+//Offsets of the sections of a truth index:
+struct HtiLayout {
+   size_t headers;
+   size_t packed;
+   size_t exception_columns;
+   size_t exception_bytes;
+   size_t site_columns;
+   size_t site_bytes;
+   size_t size;
+};
+ 
+HtiLayout hti_layout(const HtiHeader &header) {
+   HtiLayout layout;
+   size_t offset = sizeof(HtiHeader);
+   layout.headers = offset;
+   offset += header.prefix_length + header.header_lengths[0] + header.header_lengths[1];
+   offset = hsa_align(offset);
+   layout.packed = offset;
+   offset += (size_t)(header.length + 1) / 2;
+   offset = hsa_align(offset);
+   layout.exception_columns = offset;
+   offset += (size_t)header.exceptions * sizeof(uint64_t);
+   layout.exception_bytes = offset;
+   offset += (size_t)header.exceptions;
+   offset = hsa_align(offset);
+   layout.site_columns = offset;
+   offset += (size_t)header.sites * sizeof(uint64_t);
+   layout.site_bytes = offset;
+   offset += (size_t)header.sites * 2;
+   layout.size = offset;
+   return layout;
+}
+ 
+//Build the truth index of the two located true haplotype records of an alignment:
+bool write_truth_index(const string &path, const char *data, const AlignmentRecord records[NUM_RECORDS], const string &true_prefix) {
+   unsigned char codes[256];
+   hsa_codes(codes);
+   HtiHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, HTI_MAGIC, sizeof(HTI_MAGIC));
+   header.length = records[TRUE_ONE].length;
+   header.prefix_length = (uint32_t)true_prefix.length();
+   header.header_lengths[0] = (uint32_t)records[TRUE_ONE].header.length();
+   header.header_lengths[1] = (uint32_t)records[TRUE_TWO].header.length();
+   HtiLayout layout = hti_layout(header);
+   HsaWriter writer(path, sizeof(HtiHeader));
+   writer.write((const char *)&header, sizeof(header));
+   writer.write(true_prefix.data(), true_prefix.length());
+   writer.write(records[TRUE_ONE].header.data(), records[TRUE_ONE].header.length());
+   writer.write(records[TRUE_TWO].header.data(), records[TRUE_TWO].header.length());
+   writer.pad_to(layout.packed);
+   vector<uint64_t> exception_columns;
+   vector<char> exception_bytes;
+   RecordCursor bases(data, records[TRUE_ONE]);
+   if (!write_packed_record(writer, bases, (size_t)header.length, codes, exception_columns, exception_bytes)) {
+      return false;
+   }
+   //Find the sites, where the bytes of the two true haplotypes differ:
+   vector<uint64_t> site_columns;
+   vector<char> site_bytes;
+   RecordCursor true_one(data, records[TRUE_ONE]), true_two(data, records[TRUE_TWO]);
+   size_t column = 0;
+   while (column < header.length) {
+      size_t block_length = min(min(true_one.available(), true_two.available()), (size_t)header.length - column);
+      if (block_length == 0) {
+         return false;
+      }
+      const char *one = true_one.segment(), *two = true_two.segment();
+      for (size_t j = 0; j < block_length; j++) {
+         if (one[j] != two[j]) {
+            site_columns.push_back(column + j);
+            site_bytes.push_back(one[j]);
+            site_bytes.push_back(two[j]);
+         }
+      }
+      true_one.advance(block_length);
+      true_two.advance(block_length);
+      column += block_length;
+   }
+   header.exceptions = exception_columns.size();
+   header.sites = site_columns.size();
+   layout = hti_layout(header);
+   writer.pad_to(layout.exception_columns);
+   if (!exception_columns.empty()) {
+      writer.write((const char *)&exception_columns[0], exception_columns.size() * sizeof(uint64_t));
+      writer.write(&exception_bytes[0], exception_bytes.size());
+   }
+   writer.pad_to(layout.site_columns);
+   if (!site_columns.empty()) {
+      writer.write((const char *)&site_columns[0], site_columns.size() * sizeof(uint64_t));
+      writer.write(&site_bytes[0], site_bytes.size());
+   }
+   return writer.good() && writer.finish(header);
+}
+ 
+//Read-only view of a mapped truth index:
+class TruthIndex {
+   public:
+      //Returns false if the index is truncated, fails its checksum or isn't a truth index:
+      bool open(const char *data, size_t size) {
+         if (size < sizeof(HtiHeader) || memcmp(data, HTI_MAGIC, sizeof(HTI_MAGIC)) != 0) {
+            return false;
+         }
+         memcpy(&header, data, sizeof(header));
+         layout = hti_layout(header);
+         if (layout.size != size || crc32_buffer(crc32(0L, Z_NULL, 0), data + sizeof(HtiHeader), size - sizeof(HtiHeader)) != header.checksum) {
+            return false;
+         }
+         base = data;
+         prefix.assign(data + layout.headers, header.prefix_length);
+         return true;
+      }
+      size_t length() const { return (size_t)header.length; }
+      const string &true_prefix() const { return prefix; }
+      const unsigned char *packed() const { return (const unsigned char *)(base + layout.packed); }
+      size_t exceptions() const { return (size_t)header.exceptions; }
+      const uint64_t *exception_columns() const { return (const uint64_t *)(base + layout.exception_columns); }
+      const char *exception_bytes() const { return base + layout.exception_bytes; }
+      size_t sites() const { return (size_t)header.sites; }
+      const uint64_t *site_columns() const { return (const uint64_t *)(base + layout.site_columns); }
+      const char *site_bytes() const { return base + layout.site_bytes; }
+   private:
+      HtiHeader header;
+      HtiLayout layout;
+      const char *base;
+      string prefix;
+};
+ 
+//Evaluate a block of the test haplotypes (numbered from offset) against the
+// bases of the true haplotypes there from a truth index, updating the
+// counters and phase state.
+//Each slice of the block is evaluated as in evaluate_columns, except that its
+// sites come from the index instead of classifying the columns: the
+// homozygous columns are counted with the sites masked out, then the bytes
+// of the sites (the true ones from the index) are gathered into contiguous
+// columns and counted by the full kernels.
+//next_site is the first site at or after the block, and is moved past it:
+void evaluate_truth_columns(const TruthIndex &truth, const char *bases, const char *test_one, const char *test_two, size_t length, size_t offset, size_t &next_site, HapEvalState &state) {
+   size_t stride = min(SITE_SLICE_COLUMNS, length);
+   vector<uint64_t> &site_masks = state.scratch.site_masks;
+   vector<char> &gathered = state.scratch.gathered;
+   site_masks.resize((stride + 63) / 64);
+   if (gathered.size() < NUM_RECORDS * stride) {
+      gathered.resize(NUM_RECORDS * stride);
+   }
+   const uint64_t *site_columns = truth.site_columns();
+   const char *site_bytes = truth.site_bytes();
+   for (size_t start = 0; start < length; start += SITE_SLICE_COLUMNS) {
+      size_t slice_length = min(SITE_SLICE_COLUMNS, length - start);
+      fill(site_masks.begin(), site_masks.end(), 0);
+      size_t num_sites = 0;
+      for (; next_site < truth.sites() && site_columns[next_site] < offset + start + slice_length; next_site++, num_sites++) {
+         size_t i = (size_t)site_columns[next_site] - offset - start;
+         site_masks[i / 64] |= (uint64_t)1 << (i % 64);
+         gathered[num_sites] = site_bytes[2 * next_site];
+         gathered[stride + num_sites] = site_bytes[2 * next_site + 1];
+         gathered[2 * stride + num_sites] = test_one[start + i];
+         gathered[3 * stride + num_sites] = test_two[start + i];
+      }
+      size_t i = simd_kernels.count_hom_columns(bases + start, test_one + start, test_two + start, slice_length, &site_masks[0], state);
+      simd_kernels.count_hom_columns_table(bases + start + i, test_one + start + i, test_two + start + i, slice_length - i, &site_masks[i / 64], state);
+      const char *sites_true_one = &gathered[0], *sites_true_two = sites_true_one + stride,
+                 *sites_test_one = sites_true_two + stride, *sites_test_two = sites_test_one + stride;
+      i = simd_kernels.count_columns(sites_true_one, sites_true_two, sites_test_one, sites_test_two, num_sites, state);
+      simd_kernels.count_columns_table(sites_true_one + i, sites_true_two + i, sites_test_one + i, sites_test_two + i, num_sites - i, state);
+   }
+}
+ 
+//Evaluate length columns of the test haplotypes from column start against a
+// truth index, decoding the index's bases in lockstep with the test cursors.
+//Returns false if a record ends early:
+template <class Cursor>
+bool evaluate_truth_alignment(const TruthIndex &truth, Cursor &test_one, Cursor &test_two, size_t start, size_t length, HapEvalState &state) {
+   PackedCursor bases(truth.packed(), truth.length(), truth.exception_columns(), truth.exception_bytes(), truth.exceptions(), start);
+   size_t next_site = lower_bound(truth.site_columns(), truth.site_columns() + truth.sites(), (uint64_t)start) - truth.site_columns();
+   size_t position = 0;
+   while (position < length) {
+      size_t block_length = min(min(bases.available(), test_one.available()), min(test_two.available(), length - position));
+      if (block_length == 0) {
+         return false;
+      }
+      evaluate_truth_columns(truth, bases.segment(), test_one.segment(), test_two.segment(), block_length, start + position, next_site, state);
+      bases.advance(block_length);
+      test_one.advance(block_length);
+      test_two.advance(block_length);
+      position += block_length;
+   }
+   return true;
+}
+ 
+//Locate the two test haplotype records of an alignment held in memory (any
+// true haplotype records are ignored) and evaluate them against a truth index.
+//Returns 0 on success, otherwise the exit status for the error encountered:
+int evaluate_truth_buffer(const TruthIndex &truth, const char *data, size_t size, const string &true_prefix, HapEvalState &state, unsigned int num_threads) {
+   AlignmentRecord records[NUM_RECORDS];
+   locate_records(data, size, true_prefix, records);
+   if (!records[TEST_ONE].found || !records[TEST_TWO].found) {
+      return 12;
+   }
+   if (records[TEST_ONE].length != truth.length() || records[TEST_TWO].length != truth.length()) {
+      return 9;
+   }
+   auto evaluate_chunk = [&](size_t start, size_t length, HapEvalState &chunk_state) {
+      RecordCursor test_one(data, records[TEST_ONE], start), test_two(data, records[TEST_TWO], start);
+      return evaluate_truth_alignment(truth, test_one, test_two, start, length, chunk_state);
+   };
+   if (num_threads > 1 && records_seekable(records)) {
+      return evaluate_chunks_parallel(evaluate_chunk, truth.length(), state, num_threads) ? 0 : 7;
+   }
+   return evaluate_chunk(0, truth.length(), state) ? 0 : 7;
+}
+ 
+//Locate and evaluate the four records of an alignment held in memory (or
+// evaluate a packed alignment cache).
+//Returns 0 on success, otherwise the exit status for the error encountered:
+int evaluate_alignment_buffer(const char *data, size_t size, const string &true_prefix, HapEvalState &state, const EventReporting &reporting) {
+   if (is_hsa(data, size)) {
+      return evaluate_packed_alignment(data, size, state, reporting, 1);
+   }
+   AlignmentRecord records[NUM_RECORDS];
+   int status = check_records(locate_records(data, size, true_prefix, records), records);
+   if (status != 0) {
+      return status;
+   }
+   RecordCursor true_one(data, records[TRUE_ONE]), true_two(data, records[TRUE_TWO]),
+                test_one(data, records[TEST_ONE]), test_two(data, records[TEST_TWO]);
+   return evaluate_alignment(true_one, true_two, test_one, test_two, records[TRUE_ONE].length, state, reporting) ? 0 : 7;
+}
+ 
+//Evaluate the contigs of an in-memory multi-contig alignment in parallel.
+//The contigs are taken longest first by whichever thread is free next, so the
+// last contigs to start are the short ones and the threads finish close
+// together.  When there are fewer contigs than threads, the spare threads
+// split the columns of each contig between them:
+void evaluate_contigs(const char *data, vector<ContigGroup> &contigs, unsigned int num_threads) {
+   vector<size_t> order(contigs.size());
+   for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+   }
+   stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return contigs[a].records[TRUE_ONE].length > contigs[b].records[TRUE_ONE].length;
+   });
+   unsigned int num_workers = (unsigned int)max((size_t)1, min((size_t)num_threads, contigs.size()));
+   unsigned int contig_threads = max(1u, num_threads / num_workers);
+   atomic<size_t> next_contig(0);
+   auto evaluate_next_contigs = [&]() {
+      for (size_t i = next_contig++; i < order.size(); i = next_contig++) {
+         ContigGroup &contig = contigs[order[i]];
+         const AlignmentRecord *records = contig.records;
+         contig.status = check_records(contig.records_found, records);
+         if (contig.status != 0) {
+            continue;
+         }
+         bool complete = evaluate_chunks_parallel([&](size_t start, size_t length, HapEvalState &chunk_state) {
+            RecordCursor true_one(data, records[TRUE_ONE], start), true_two(data, records[TRUE_TWO], start),
+                         test_one(data, records[TEST_ONE], start), test_two(data, records[TEST_TWO], start);
+            return evaluate_alignment(true_one, true_two, test_one, test_two, length, chunk_state, EventReporting(), start);
+         }, records[TRUE_ONE].length, contig.state, records_seekable(records) ? contig_threads : 1);
+         contig.status = complete ? 0 : 7;
+      }
+   };
+   vector<thread> workers;
+   for (unsigned int t = 1; t < num_workers; t++) {
+      workers.push_back(thread(evaluate_next_contigs));
+   }
+   evaluate_next_contigs();
+   for (size_t t = 0; t < workers.size(); t++) {
+      workers[t].join();
+   }
+}
+ 
+//Most true (and test) haplotypes of a polyploid alignment, so that a set of
+// true haplotypes fits in a 32-bit mask:
+const unsigned int MAX_PLOIDY = 32;
+ 
+//Counters and phase state of a polyploid evaluation, per test haplotype.
+//Rather than an identity, each test haplotype keeps the set of true haplotypes
+// it has matched at every informative het SNP since its last switch, so the
+// state is a bitset per test haplotype whatever the ploidy:
+struct PolyploidEvalState {
+   unsigned int ploidy;
+   vector<uint32_t> phase; //0 before the first informative het SNP
+   vector<unsigned long int> switches, false_snps, false_indels, bad_calls;
+   PolyploidEvalState(unsigned int ploidy) : ploidy(ploidy), phase(ploidy, 0), switches(ploidy, 0), false_snps(ploidy, 0),
+                                             false_indels(ploidy, 0), bad_calls(ploidy, 0) {}
+};
+ 
+//Evaluate a block of columns of a polyploid alignment one at a time.  With two
+// true and two test haplotypes, this counts exactly what evaluate_columns_scalar does:
+// -At a homozygous site, any gap in the test haplotypes makes a false indel of
+//  each test haplotype without one, otherwise if the test haplotypes disagree,
+//  the first not matching the true base has a false SNP.
+// -At a true indel, the first test haplotype matching no true haplotype has a false SNP.
+// -At a het SNP, the true haplotypes a test haplotype matches are its candidates.
+//  None is a bad call, and all carries no phase.  Otherwise the candidates are
+//  intersected with the test haplotype's phase, and a switch is counted when
+//  that leaves none, starting over from the candidates.  A switch is thus only
+//  counted when no one true haplotype explains the run since the last one, at
+//  a cost linear in the number of distinct true bases per test haplotype.
+//Runs of 8 columns identical in all the haplotypes are skipped a word at a time:
+template <BaseComparison comparison>
+void evaluate_polyploid_columns(const char *const *true_bases, const char *const *test_bases, size_t length, PolyploidEvalState &state) {
+   unsigned int ploidy = state.ploidy;
+   uint32_t all_true = ploidy == 32 ? ~(uint32_t)0 : ((uint32_t)1 << ploidy) - 1;
+   char alleles[MAX_PLOIDY];
+   uint32_t allele_haplotypes[MAX_PLOIDY];
+   size_t i = 0;
+   while (i < length) {
+      if (i + 8 <= length) {
+         uint64_t word = load_word(true_bases[0] + i);
+         unsigned int h = 1;
+         while (h < ploidy && load_word(true_bases[h] + i) == word) {
+            h++;
+         }
+         for (unsigned int t = 0; h == ploidy && t < ploidy; t++) {
+            h = load_word(test_bases[t] + i) == word ? h : 0;
+         }
+         if (h == ploidy) {
+            i += 8;
+            continue;
+         }
+      }
+      //Group the true haplotypes by their base:
+      unsigned int num_alleles = 0;
+      bool homozygous = true, true_gap = false;
+      for (unsigned int h = 0; h < ploidy; h++) {
+         char base = true_bases[h][i];
+         unsigned int allele = 0;
+         while (allele < num_alleles && alleles[allele] != base) {
+            allele++;
+         }
+         if (allele == num_alleles) {
+            alleles[num_alleles] = base;
+            allele_haplotypes[num_alleles++] = 0;
+         }
+         allele_haplotypes[allele] |= (uint32_t)1 << h;
+         homozygous = homozygous && bases_match<comparison>(base, alleles[0]);
+         true_gap = true_gap || base == '-';
+      }
+      if (homozygous) { //Homozygous site
+         unsigned int gaps = 0;
+         for (unsigned int t = 0; t < ploidy; t++) {
+            gaps += test_bases[t][i] == '-';
+         }
+         if (gaps > 0) { //False indel
+            for (unsigned int t = 0; t < ploidy; t++) {
+               state.false_indels[t] += test_bases[t][i] != '-';
+            }
+         } else {
+            unsigned int disagreeing = 1;
+            while (disagreeing < ploidy && bases_match<comparison>(test_bases[disagreeing][i], test_bases[0][i])) {
+               disagreeing++;
+            }
+            if (disagreeing < ploidy) { //False SNP
+               unsigned int t = 0;
+               while (t < ploidy && bases_match<comparison>(test_bases[t][i], alleles[0])) {
+                  t++;
+               }
+               state.false_snps[t < ploidy ? t : disagreeing]++;
+            }
+         }
+      } else {
+         for (unsigned int t = 0; t < ploidy; t++) {
+            uint32_t candidates = 0;
+            for (unsigned int allele = 0; allele < num_alleles; allele++) {
+               candidates |= bases_match<comparison>(test_bases[t][i], alleles[allele]) ? allele_haplotypes[allele] : 0;
+            }
+            if (true_gap) { //Indel
+               if (candidates == 0) {
+                  state.false_snps[t]++;
+                  break;
+               }
+            } else if (candidates == 0) { //Heterozygous SNP
+               state.bad_calls[t]++;
+            } else if (candidates != all_true) {
+               uint32_t phase = state.phase[t] & candidates;
+               if (phase == 0 && state.phase[t] != 0) { //Phase switch occurred
+                  state.switches[t]++;
+               }
+               state.phase[t] = phase != 0 ? phase : candidates;
+            }
+         }
+      }
+      i++;
+   }
+}
+ 
+//Evaluate a polyploid alignment, with ploidy true haplotype records followed
+// by ploidy test haplotype records, along one cursor per record.
+//Returns false if any record ended early:
+template <class Cursor>
+bool evaluate_polyploid_alignment(deque<Cursor> &cursors, size_t length, PolyploidEvalState &state) {
+   vector<const char *> segments(cursors.size());
+   size_t position = 0;
+   while (position < length) {
+      size_t block_length = length - position;
+      for (size_t r = 0; r < cursors.size(); r++) {
+         block_length = min(block_length, cursors[r].available());
+         segments[r] = cursors[r].segment();
+      }
+      if (block_length == 0) {
+         return false;
+      }
+      if (simd_kernels.comparison == COMPARE_CASE) {
+         evaluate_polyploid_columns<COMPARE_CASE>(&segments[0], &segments[state.ploidy], block_length, state);
+      } else if (simd_kernels.comparison == COMPARE_IUPAC) {
+         evaluate_polyploid_columns<COMPARE_IUPAC>(&segments[0], &segments[state.ploidy], block_length, state);
+      } else {
+         evaluate_polyploid_columns<COMPARE_EXACT>(&segments[0], &segments[state.ploidy], block_length, state);
+      }
+      for (size_t r = 0; r < cursors.size(); r++) {
+         cursors[r].advance(block_length);
+      }
+      position += block_length;
+   }
+   return true;
+}
+ 
+//Locate and evaluate the true and test haplotype records of a polyploid
+// alignment held in memory.  Phase carries along the whole alignment, so
+// unlike the diploid state, the columns can't be split across threads.
+//Returns 0 on success, otherwise the exit status for the error encountered:
+int evaluate_polyploid_buffer(const char *data, size_t size, const string &true_prefix, PolyploidEvalState &state) {
+   unsigned int num_records = 2 * state.ploidy;
+   vector<AlignmentRecord> records(num_records);
+   if (locate_records(data, size, true_prefix, &records[0], state.ploidy) < num_records) {
+      return 14;
+   }
+   deque<RecordCursor> cursors;
+   for (unsigned int r = 0; r < num_records; r++) {
+      if (records[r].length != records[0].length) {
+         return 9;
+      }
+      cursors.emplace_back(data, records[r]);
+   }
+   return evaluate_polyploid_alignment(cursors, records[0].length, state) ? 0 : 7;
+}
+ 
+//Partial results (.hsp):
+//The state after evaluating one range of columns of an alignment, written by
+// a run given a region so that the ranges can be evaluated by separate
+// processes, and the merge subcommand can combine the ranges into exactly the
+// result of evaluating the whole alignment.  Besides the counters, this holds
+// the identities of each test haplotype at the first and last informative het
+// SNPs of the range, and the runs of identical columns at either end, which
+// are what merge_states needs.
+//Layout (native byte order): the fixed record below, with a CRC-32 of all
+// the fields before the checksum:
+const char HSP_MAGIC[8] = {'H', 'S', 'A', 'P', 'A', 'R', 'T', '1'};
+ 
+struct PartialResult {
+   char magic[8];
+   uint64_t start, end; //Columns [start, end) evaluated
+   uint64_t alignment_length;
+   uint64_t comparison; //BaseComparison the range was evaluated with
+   uint64_t ids[4]; //First and latest identities of test haplotype 1, then of test haplotype 2
+   uint64_t counts[8]; //Switches, false SNPs, false indels and bad calls, for test haplotype 1 then 2 in turn
+   uint64_t runs[7]; //The RunStats fields in order
+   uint32_t checksum;
+   uint32_t reserved;
+};
+ 
+//Convert a state to a partial result for the range of columns, and back:
+void state_to_partial(const HapEvalState &state, const ColumnRange &region, BaseComparison comparison, PartialResult &partial) {
+   memset(&partial, 0, sizeof(partial));
+   memcpy(partial.magic, HSP_MAGIC, sizeof(HSP_MAGIC));
+   partial.start = region.start;
+   partial.end = region.end;
+   partial.alignment_length = region.alignment_length;
+   partial.comparison = comparison;
+   uint64_t ids[4] = {state.test_one_first_id, state.test_one_id, state.test_two_first_id, state.test_two_id};
+   uint64_t counts[8] = {state.test_one_switches, state.test_two_switches, state.test_one_false_snps, state.test_two_false_snps,
+                         state.test_one_false_indels, state.test_two_false_indels, state.test_one_bad_calls, state.test_two_bad_calls};
+   uint64_t runs[7] = {state.runs.columns, state.runs.identical_columns, state.runs.runs, state.runs.longest_run,
+                       state.runs.leading_run, state.runs.trailing_run, state.runs.skipped_columns};
+   memcpy(partial.ids, ids, sizeof(ids));
+   memcpy(partial.counts, counts, sizeof(counts));
+   memcpy(partial.runs, runs, sizeof(runs));
+   partial.checksum = (uint32_t)crc32_buffer(crc32(0L, Z_NULL, 0), (const char *)&partial, offsetof(PartialResult, checksum));
+}
+ 
+void partial_to_state(const PartialResult &partial, HapEvalState &state) {
+   state.test_one_first_id = (unsigned short int)partial.ids[0];
+   state.test_one_id = (unsigned short int)partial.ids[1];
+   state.test_two_first_id = (unsigned short int)partial.ids[2];
+   state.test_two_id = (unsigned short int)partial.ids[3];
+   unsigned long int *counts[8] = {&state.test_one_switches, &state.test_two_switches, &state.test_one_false_snps, &state.test_two_false_snps,
+                                   &state.test_one_false_indels, &state.test_two_false_indels, &state.test_one_bad_calls, &state.test_two_bad_calls};
+   uint64_t *runs[7] = {&state.runs.columns, &state.runs.identical_columns, &state.runs.runs, &state.runs.longest_run,
+                        &state.runs.leading_run, &state.runs.trailing_run, &state.runs.skipped_columns};
+   for (unsigned short int i = 0; i < 8; i++) {
+      *counts[i] = (unsigned long int)partial.counts[i];
+   }
+   for (unsigned short int i = 0; i < 7; i++) {
+      *runs[i] = partial.runs[i];
+   }
+}
+ 
+//Write a partial result, returning false if it couldn't be written:
+bool write_partial(const string &path, const PartialResult &partial) {
+   ofstream output(path.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+   output.write((const char *)&partial, sizeof(partial));
+   output.close();
+   return !output.fail();
+}
+ 
+//Read a partial result, returning false if it can't be read or is corrupt:
+bool read_partial(const string &path, PartialResult &partial) {
+   ifstream input(path.c_str(), ios_base::in | ios_base::binary);
+   if (!input.read((char *)&partial, sizeof(partial)) || input.peek() != EOF) {
+      return false;
+   }
+   return memcmp(partial.magic, HSP_MAGIC, sizeof(HSP_MAGIC)) == 0 &&
+          partial.checksum == (uint32_t)crc32_buffer(crc32(0L, Z_NULL, 0), (const char *)&partial, offsetof(PartialResult, checksum)) &&
+          partial.start <= partial.end && partial.end <= partial.alignment_length && partial.comparison <= COMPARE_IUPAC &&
+          partial.ids[0] <= 2 && partial.ids[1] <= 2 && partial.ids[2] <= 2 && partial.ids[3] <= 2;
+}
+ 
+#ifdef HAVE_IO_URING
+//Minimal io_uring submission and completion rings, set up with the raw system
+// calls so that liburing isn't needed:
+class IoUring {
+   public:
+      IoUring() : ring_fd(-1), sq_ring(MAP_FAILED), cq_ring(MAP_FAILED), sqes(MAP_FAILED), sq_ring_size(0), cq_ring_size(0),
+                  sqes_size(0), capacity(0), unsubmitted(0) {}
+      ~IoUring() {
+         if (sqes != MAP_FAILED) {
+            munmap(sqes, sqes_size);
+         }
+         if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+         }
+         if (sq_ring != MAP_FAILED) {
+            munmap(sq_ring, sq_ring_size);
+         }
+         if (ring_fd >= 0) {
+            close(ring_fd);
+         }
+      }
+      //Returns false if io_uring isn't available:
+      bool setup(unsigned int entries) {
+         struct io_uring_params params;
+         memset(&params, 0, sizeof(params));
+         ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+         if (ring_fd < 0) {
+            return false;
+         }
+         sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+         cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+         bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+         if (single_mmap) {
+            sq_ring_size = cq_ring_size = max(sq_ring_size, cq_ring_size);
+         }
+         sq_ring = mmap(0, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+         if (sq_ring == MAP_FAILED) {
+            return false;
+         }
+         cq_ring = single_mmap ? sq_ring : mmap(0, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+         sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+         sqes = mmap(0, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+         if (cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+            return false;
+         }
+         sq_head = (unsigned int *)((char *)sq_ring + params.sq_off.head);
+         sq_tail = (unsigned int *)((char *)sq_ring + params.sq_off.tail);
+         sq_mask = (unsigned int *)((char *)sq_ring + params.sq_off.ring_mask);
+         sq_array = (unsigned int *)((char *)sq_ring + params.sq_off.array);
+         cq_head = (unsigned int *)((char *)cq_ring + params.cq_off.head);
+         cq_tail = (unsigned int *)((char *)cq_ring + params.cq_off.tail);
+         cq_mask = (unsigned int *)((char *)cq_ring + params.cq_off.ring_mask);
+         cqes = (struct io_uring_cqe *)((char *)cq_ring + params.cq_off.cqes);
+         capacity = params.sq_entries;
+         return true;
+      }
+      unsigned int size() const { return capacity; }
+      //Queue a read described by iov (which must stay valid until it completes):
+      void queue_read(int fd, const struct iovec *iov, size_t offset, uint64_t user_data) {
+         unsigned int tail = *sq_tail;
+         unsigned int index = tail & *sq_mask;
+         struct io_uring_sqe *sqe = (struct io_uring_sqe *)sqes + index;
+         memset(sqe, 0, sizeof(*sqe));
+         sqe->opcode = IORING_OP_READV;
+         sqe->fd = fd;
+         sqe->off = offset;
+         sqe->addr = (uint64_t)(uintptr_t)iov;
+         sqe->len = 1;
+         sqe->user_data = user_data;
+         sq_array[index] = index;
+         __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+         unsubmitted++;
+      }
+      //Submit the queued reads and wait for at least one completion:
+      bool submit_and_wait() {
+         int submitted = (int)syscall(__NR_io_uring_enter, ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, 0, 0);
+         if (submitted < 0) {
+            return errno == EINTR;
+         }
+         unsubmitted -= (unsigned int)submitted;
+         return true;
+      }
+      //Wait for at least one completion without submitting the queued reads:
+      bool wait() {
+         while (syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, 0, 0) < 0) {
+            if (errno != EINTR) {
+               return false;
+            }
+         }
+         return true;
+      }
+      //Number of reads queued but not yet submitted:
+      unsigned int queued() const { return unsubmitted; }
+      //Take the next completion, if any:
+      bool next_completion(uint64_t &user_data, int &result) {
+         unsigned int head = *cq_head;
+         if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            return false;
+         }
+         struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+         user_data = cqe->user_data;
+         result = cqe->res;
+         __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+         return true;
+      }
+   private:
+      IoUring(const IoUring &);
+      IoUring &operator=(const IoUring &);
+      int ring_fd;
+      void *sq_ring, *cq_ring, *sqes;
+      size_t sq_ring_size, cq_ring_size, sqes_size;
+      unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+      unsigned int *cq_head, *cq_tail, *cq_mask;
+      struct io_uring_cqe *cqes;
+      unsigned int capacity;
+      unsigned int unsubmitted;
+};
+#endif
+ 
+//An alignment file of a batch:
+struct BatchFile {
+   string path;
+   string true_prefix; //Prefix of the true haplotypes of this file, if not the one given with -p
+   vector<char> data; //Contents once loaded, released again after evaluation
+   int status; //0 unless loading or evaluating failed, then the exit status for the error
+   HapEvalState state;
+   BatchFile() : status(0) {}
+};
+ 
+//Number of reads kept in flight by the io_uring batch loader:
+const unsigned int BATCH_QUEUE_DEPTH = 64;
+ 
+//Memory allowed for files that are loaded but not yet evaluated:
+const size_t BATCH_MEMORY_BUDGET = (size_t)1 << 30;
+ 
+//Loads the files of a batch into memory, keeping many reads in flight across
+// files with io_uring where it's available, and falling back to pread:
+class BatchLoader {
+   public:
+      BatchLoader(vector<BatchFile> &files) : files(files), reserved(0) {}
+      //Load every file, calling loaded(i) as soon as file i is ready for evaluation:
+      void run(const function<void(size_t)> &loaded) {
+#ifdef HAVE_IO_URING
+         IoUring ring;
+         if (ring.setup(BATCH_QUEUE_DEPTH)) {
+            run_io_uring(ring, loaded);
+            return;
+         }
+#endif
+         run_pread(loaded);
+      }
+      //Return the memory of an evaluated file to the budget:
+      void release(size_t bytes) {
+         lock_guard<mutex> lock(budget_mutex);
+         reserved -= bytes;
+         budget_available.notify_all();
+      }
+   private:
+      bool open_file(size_t i, int &fd, size_t &size) {
+         if (files[i].status != 0) { //A glob pattern that matched nothing
+            return false;
+         }
+         struct stat file_stat;
+         fd = open(files[i].path.c_str(), O_RDONLY);
+         if (fd < 0 || fstat(fd, &file_stat) != 0) {
+            if (fd >= 0) {
+               close(fd);
+            }
+            files[i].status = 5;
+            return false;
+         }
+         size = (size_t)file_stat.st_size;
+         return true;
+      }
+      //A file bigger than the whole budget is still loaded once nothing else is:
+      bool try_reserve(size_t bytes) {
+         lock_guard<mutex> lock(budget_mutex);
+         if (reserved > 0 && reserved + bytes > BATCH_MEMORY_BUDGET) {
+            return false;
+         }
+         reserved += bytes;
+         return true;
+      }
+      void reserve(size_t bytes) {
+         unique_lock<mutex> lock(budget_mutex);
+         while (reserved > 0 && reserved + bytes > BATCH_MEMORY_BUDGET) {
+            budget_available.wait(lock);
+         }
+         reserved += bytes;
+      }
+      //Read the rest of file i from done onwards, then close it:
+      void read_rest(size_t i, int fd, size_t done) {
+         size_t size = files[i].data.size();
+         while (done < size) {
+            ssize_t bytes_read = pread(fd, &files[i].data[done], size - done, (off_t)done);
+            if (bytes_read < 0 && errno == EINTR) {
+               continue;
+            }
+            if (bytes_read <= 0) {
+               files[i].status = 7;
+               break;
+            }
+            done += (size_t)bytes_read;
+         }
+         close(fd);
+      }
+      void run_pread(const function<void(size_t)> &loaded, size_t first_file = 0) {
+         for (size_t i = first_file; i < files.size(); i++) {
+            int fd;
+            size_t size;
+            if (open_file(i, fd, size)) {
+               reserve(size);
+               files[i].data.resize(size);
+               read_rest(i, fd, 0);
+            }
+            loaded(i);
+         }
+      }
+#ifdef HAVE_IO_URING
+      struct PendingRead {
+         int fd;
+         size_t done;
+         struct iovec iov;
+      };
+      void run_io_uring(IoUring &ring, const function<void(size_t)> &loaded) {
+         vector<PendingRead> reads(files.size());
+         size_t next_file = 0;
+         unsigned int in_flight = 0;
+         int waiting_fd = -1; //Opened, but waiting for memory
+         size_t waiting_size = 0;
+         while (next_file < files.size() || in_flight > 0) {
+            //Start reading more files while there is room in the ring and the budget:
+            while (next_file < files.size() && in_flight < ring.size()) {
+               size_t i = next_file;
+               int fd = waiting_fd;
+               size_t size = waiting_size;
+               if (fd < 0 && !open_file(i, fd, size)) {
+                  next_file++;
+                  loaded(i);
+                  continue;
+               }
+               if (!try_reserve(size)) {
+                  if (in_flight > 0) {
+                     waiting_fd = fd;
+                     waiting_size = size;
+                     break;
+                  }
+                  reserve(size);
+               }
+               waiting_fd = -1;
+               next_file++;
+               files[i].data.resize(size);
+               if (size == 0) {
+                  close(fd);
+                  loaded(i);
+                  continue;
+               }
+               reads[i].fd = fd;
+               reads[i].done = 0;
+               reads[i].iov.iov_base = &files[i].data[0];
+               reads[i].iov.iov_len = size;
+               ring.queue_read(fd, &reads[i].iov, 0, i);
+               in_flight++;
+            }
+            if (in_flight == 0) {
+               continue;
+            }
+            if (!ring.submit_and_wait()) { //Shouldn't happen once the ring is set up, but finish with pread rather than hang
+               finish_with_pread(ring, reads, in_flight, next_file, waiting_fd, loaded);
+               return;
+            }
+            //Resubmit short reads, and hand over the files that are complete:
+            uint64_t user_data;
+            int result;
+            while (ring.next_completion(user_data, result)) {
+               size_t i = (size_t)user_data;
+               PendingRead &read = reads[i];
+               if (result == -EINTR || result == -EAGAIN) {
+                  ring.queue_read(read.fd, &read.iov, read.done, i);
+                  continue;
+               }
+               if (result > 0) {
+                  read.done += (size_t)result;
+                  if (read.done < files[i].data.size()) {
+                     read.iov.iov_base = &files[i].data[read.done];
+                     read.iov.iov_len = files[i].data.size() - read.done;
+                     ring.queue_read(read.fd, &read.iov, read.done, i);
+                     continue;
+                  }
+               } else {
+                  files[i].status = 7;
+               }
+               close(read.fd);
+               read.iov.iov_base = 0;
+               in_flight--;
+               loaded(i);
+            }
+         }
+      }
+      //Once the ring fails, queue no more reads, but wait for those the kernel
+      // already has, since it may still write into their buffers.  Then read the
+      // rest of the unfinished files, and all the files not yet started, with pread:
+      void finish_with_pread(IoUring &ring, vector<PendingRead> &reads, unsigned int in_flight, size_t next_file, int waiting_fd,
+                             const function<void(size_t)> &loaded) {
+         unsigned int submitted = in_flight - ring.queued(); //Each file has at most one read queued or submitted
+         while (submitted > 0) {
+            uint64_t user_data;
+            int result;
+            if (!ring.next_completion(user_data, result)) {
+               if (!ring.wait()) {
+                  break;
+               }
+               continue;
+            }
+            submitted--;
+            PendingRead &read = reads[(size_t)user_data];
+            if (result > 0) {
+               read.done += (size_t)result;
+            }
+         }
+         for (size_t i = 0; i < next_file; i++) {
+            if (reads[i].iov.iov_base == 0) {
+               continue;
+            }
+            if (submitted > 0) { //Still can't tell which reads the kernel has, so keep every unfinished buffer
+               files[i].status = 7;
+               release(files[i].data.size()); //Not counted against the budget, or the files left might never fit
+               stranded.push_back(vector<char>());
+               stranded.back().swap(files[i].data);
+               close(reads[i].fd);
+            } else {
+               read_rest(i, reads[i].fd, reads[i].done);
+            }
+            reads[i].iov.iov_base = 0;
+            loaded(i);
+         }
+         if (waiting_fd >= 0) { //Opened, but not yet reserved, so reopen it below
+            close(waiting_fd);
+         }
+         run_pread(loaded, next_file);
+      }
+#endif
+      vector<BatchFile> &files;
+      vector<vector<char> > stranded; //Buffers of reads the kernel may never have finished
+      size_t reserved;
+      mutex budget_mutex;
+      condition_variable budget_available;
+};
+ 
+//Work-stealing queue of loaded files waiting for the worker threads:
+//Each worker has a queue of its own, which the files are dealt to in turn, so
+// that the workers rarely contend for a lock.  A worker takes the oldest
+// file from its own queue, and once that is empty, steals the newest file
+// from another worker's, so no worker sits idle while files are waiting:
+class WorkQueue {
+   public:
+      WorkQueue(unsigned int num_workers) : queues(num_workers), next_queue(0), pending(0), closed(false) {}
+      //Only one thread pushes items:
+      void push(size_t item) {
+         WorkerQueue &queue = queues[next_queue];
+         next_queue = (next_queue + 1) % queues.size();
+         {
+            lock_guard<mutex> lock(queue.queue_mutex);
+            queue.items.push_back(item);
+         }
+         {
+            lock_guard<mutex> lock(wait_mutex);
+            pending++;
+         }
+         item_available.notify_one();
+      }
+      //No more items will be pushed:
+      void close() {
+         lock_guard<mutex> lock(wait_mutex);
+         closed = true;
+         item_available.notify_all();
+      }
+      //Returns false once the queue is closed and empty:
+      bool pop(unsigned int worker, size_t &item) {
+         while (true) {
+            for (size_t k = 0; k < queues.size(); k++) {
+               WorkerQueue &queue = queues[(worker + k) % queues.size()];
+               lock_guard<mutex> lock(queue.queue_mutex);
+               if (!queue.items.empty()) {
+                  if (k == 0) {
+                     item = queue.items.front();
+                     queue.items.pop_front();
+                  } else {
+                     item = queue.items.back();
+                     queue.items.pop_back();
+                  }
+                  pending--;
+                  return true;
+               }
+            }
+            unique_lock<mutex> lock(wait_mutex);
+            while (pending == 0 && !closed) {
+               item_available.wait(lock);
+            }
+            if (pending == 0) {
+               return false;
+            }
+         }
+      }
+   private:
+      struct WorkerQueue {
+         deque<size_t> items;
+         mutex queue_mutex;
+      };
+      vector<WorkerQueue> queues;
+      size_t next_queue;
+      atomic<size_t> pending; //Items pushed but not yet taken, only increased while holding wait_mutex
+      bool closed;
+      mutex wait_mutex;
+      condition_variable item_available;
+};
+ 
+//Add the alignment files of a manifest path to a batch.  A glob pattern is
+// expanded to the matching files in sorted order.  If nothing matches, the
+// pattern is kept unopened as a file that couldn't be opened, so that it
+// still shows up in the results and in the exit status:
+void add_batch_files(const string &path, const string &true_prefix, vector<BatchFile> &files) {
+   glob_t matches;
+   bool pattern = path.find_first_of("*?[") != string::npos;
+   if (!pattern || glob(path.c_str(), 0, 0, &matches) != 0) {
+      if (pattern) {
+         globfree(&matches);
+      }
+      files.push_back(BatchFile());
+      files.back().path = path;
+      files.back().true_prefix = true_prefix;
+      files.back().status = pattern ? 5 : 0;
+      return;
+   }
+   for (size_t i = 0; i < matches.gl_pathc; i++) {
+      files.push_back(BatchFile());
+      files.back().path = matches.gl_pathv[i];
+      files.back().true_prefix = true_prefix;
+   }
+   globfree(&matches);
+}
+ 
+//Read the alignment file paths (or glob patterns) of a batch, one per line,
+// each optionally followed by a tab and the true haplotype prefix for its
+// files, skipping blank lines and # comments:
+bool read_manifest(const string &manifest_file, vector<BatchFile> &files) {
+   ifstream manifest(manifest_file.c_str(), ios_base::in);
+   string line_buffer;
+   if (!manifest) {
+      return false;
+   }
+   while (getline(manifest, line_buffer)) {
+      if (!line_buffer.empty() && line_buffer[line_buffer.length()-1] == '\r') {
+         line_buffer.erase(line_buffer.length()-1);
+      }
+      if (line_buffer.empty() || line_buffer[0] == '#') {
+         continue;
+      }
+      size_t tab = line_buffer.find('\t');
+      add_batch_files(line_buffer.substr(0, tab), tab != string::npos ? line_buffer.substr(tab + 1) : string(), files);
+   }
+   return manifest.eof();
+}
+ 
+//Output the header line of a table of results, one row per alignment or contig:
+void print_results_header(const char *first_column) {
+   cout << first_column << "\tStatus\tSwitches1\tSwitches2\tFalseSNPs1\tFalseSNPs2\tFalseIndels1\tFalseIndels2\tBadCalls1\tBadCalls2" << endl;
+}
+ 
+//Output one row of a table of results:
+void print_results_row(const string &name, int status, const HapEvalState &state) {
+   cout << name << '\t' << status << '\t'
+        << state.test_one_switches << '\t' << state.test_two_switches << '\t'
+        << state.test_one_false_snps << '\t' << state.test_two_false_snps << '\t'
+        << state.test_one_false_indels << '\t' << state.test_two_false_indels << '\t'
+        << state.test_one_bad_calls << '\t' << state.test_two_bad_calls << endl;
+}
+ 
+//Evaluate every alignment of a batch, with the loader (on this thread) reading
+// files while the worker threads evaluate the ones already loaded, then output
+// one results table in manifest order, whatever order the files finished in.
+//With a truth index, only the test haplotypes of each file are evaluated against it.
+//Returns 0 if every file was evaluated, otherwise the exit status of the
+// first that wasn't:
+int run_batch(vector<BatchFile> &files, const string &true_prefix, unsigned int num_threads, const TruthIndex *truth) {
+   BatchLoader loader(files);
+   WorkQueue loaded_files(num_threads);
+   vector<thread> workers;
+   for (unsigned int t = 0; t < num_threads; t++) {
+      workers.push_back(thread([&, t]() {
+         size_t i;
+         while (loaded_files.pop(t, i)) {
+            BatchFile &file = files[i];
+            size_t loaded_size = file.data.size();
+            if (file.status == 0) {
+               vector<char> inflated;
+               const char *data = file.data.empty() ? 0 : &file.data[0];
+               size_t size = file.data.size();
+               if (is_gzip(data, size)) {
+                  if (!inflate_alignment(data, size, inflated, 1)) {
+                     file.status = 7;
+                  }
+                  data = inflated.empty() ? 0 : &inflated[0];
+                  size = inflated.size();
+               }
+               const string &file_prefix = file.true_prefix.empty() ? true_prefix : file.true_prefix;
+               if (file.status == 0 && truth != 0) {
+                  file.status = evaluate_truth_buffer(*truth, data, size, file_prefix, file.state, 1);
+               } else if (file.status == 0) {
+                  file.status = evaluate_alignment_buffer(data, size, file_prefix, file.state, EventReporting());
+               }
+            }
+            vector<char>().swap(file.data);
+            loader.release(loaded_size);
+         }
+      }));
+   }
+   loader.run([&](size_t i) { loaded_files.push(i); });
+   loaded_files.close();
+   for (unsigned int t = 0; t < num_threads; t++) {
+      workers[t].join();
+   }
+   int status = 0;
+   print_results_header("Alignment");
+   for (size_t i = 0; i < files.size(); i++) {
+      print_results_row(files[i].path, files[i].status, files[i].state);
+      if (status == 0) {
+         status = files[i].status;
+      }
+   }
+   if (status != 0) {
+      cerr << "Alignments with a nonzero status could not be evaluated, so their counts were left out." << endl;
+   }
+   return status;
+}
+ 
+//Close the binary event file, if any, returning false if writing it failed:
+bool close_event_output(EventReporting &reporting) {
+   if (reporting.binary_output == 0) {
+      return true;
+   }
+   bool written = !ferror(reporting.binary_output);
+   written = fclose(reporting.binary_output) == 0 && written;
+   reporting.binary_output = 0;
+   if (!written) {
+      cerr << "Unable to write the event file." << endl;
+   }
+   return written;
+}
+ 
+//Output the summary of the evaluation:
+void print_summary(const HapEvalState &state) {
+   cout << "Haplotype switches for test haplotype 1: " << state.test_one_switches << endl;
+   cout << "Haplotype switches for test haplotype 2: " << state.test_two_switches << endl;
+   cout << "False SNPs in haplotype 1: " << state.test_one_false_snps << endl;
+   cout << "False SNPs in haplotype 2: " << state.test_two_false_snps << endl;
+   cout << "False indels in haplotype 1: " << state.test_one_false_indels << endl;
+   cout << "False indels in haplotype 2: " << state.test_two_false_indels << endl;
+   cout << "Bad base calls in haplotype 1: " << state.test_one_bad_calls << endl;
+   cout << "Bad base calls in haplotype 2: " << state.test_two_bad_calls << endl;
+}
+ 
+//Output the summary of a polyploid evaluation, in the same form as for two
+// test haplotypes:
+void print_polyploid_summary(const PolyploidEvalState &state) {
+   for (unsigned int t = 0; t < state.ploidy; t++) {
+      cout << "Haplotype switches for test haplotype " << t+1 << ": " << state.switches[t] << endl;
+   }
+   for (unsigned int t = 0; t < state.ploidy; t++) {
+      cout << "False SNPs in haplotype " << t+1 << ": " << state.false_snps[t] << endl;
+   }
+   for (unsigned int t = 0; t < state.ploidy; t++) {
+      cout << "False indels in haplotype " << t+1 << ": " << state.false_indels[t] << endl;
+   }
+   for (unsigned int t = 0; t < state.ploidy; t++) {
+      cout << "Bad base calls in haplotype " << t+1 << ": " << state.bad_calls[t] << endl;
+   }
+}
+ 
+//Output the statistics of the runs of identical columns:
+void print_run_stats(const RunStats &runs) {
+   cout << "Columns identical in all four haplotypes: " << runs.identical_columns << " of " << runs.columns << endl;
+   cout << "Runs of identical columns: " << runs.runs << endl;
+   cout << "Longest run of identical columns: " << runs.longest_run << endl;
+   cout << "Mean run of identical columns: " << (runs.runs != 0 ? (double)runs.identical_columns / runs.runs : 0.0) << endl;
+   cout << "Columns skipped in identical groups of 64: " << runs.skipped_columns << endl;
+}
+ 
+//Output the results of each contig in the order they appear in the alignment,
+// then the genome-wide totals of the contigs that could be evaluated.
+//Returns 0 if every contig was evaluated, otherwise the exit status of the
+// first that wasn't:
+int print_contig_results(const vector<ContigGroup> &contigs, bool run_stats) {
+   HapEvalState genome;
+   int status = 0;
+   size_t contigs_evaluated = 0;
+   print_results_header("Contig");
+   for (size_t i = 0; i < contigs.size(); i++) {
+      print_results_row(contigs[i].name, contigs[i].status, contigs[i].state);
+      if (contigs[i].status == 0) {
+         add_contig_state(genome, contigs[i].state);
+         contigs_evaluated++;
+      } else if (status == 0) {
+         status = contigs[i].status;
+      }
+   }
+   cout << "Contigs evaluated: " << contigs_evaluated << " of " << contigs.size() << endl;
+   print_summary(genome);
+   if (run_stats) {
+      print_run_stats(genome.runs);
+   }
+   if (status != 0) {
+      cerr << "Contigs with a nonzero status were left out of the genome-wide totals." << endl;
+   }
+   return status;
+}
+ 
+//Output the summary (and any run statistics) of an evaluation, or if a partial
+// result file is given, write the state to it instead.
+//Returns the exit status:
+int output_result(const HapEvalState &state, const ColumnRange &region, BaseComparison comparison, const string &partial_file, bool run_stats) {
+   if (!partial_file.empty()) {
+      PartialResult partial;
+      state_to_partial(state, region, comparison, partial);
+      if (!write_partial(partial_file, partial)) {
+         cerr << "Unable to write the partial result " << partial_file << endl;
+         return 7;
+      }
+      return 0;
+   }
+   print_summary(state);
+   if (run_stats) {
+      print_run_stats(state.runs);
+   }
+   return 0;
+}
+ 
+//The pack subcommand: locate the four records of an alignment and write them
+// to a packed alignment cache for later evaluations:
+int pack_main(int argc, char *argv[]) {
+   int helpflag = 0;
+   int interleave_flag = 0;
+   unsigned int num_threads = max(1u, thread::hardware_concurrency());
+   int optvalue;
+   int optindex = 0;
+   struct option long_options[] =
+      {
+         {"help", no_argument, &helpflag, 1},
+         {"interleave", no_argument, &interleave_flag, 1},
+         {"threads", required_argument, 0, 't'},
+         {"true_prefix", required_argument, 0, 'p'},
+         {0,0,0,0}
+      };
+   string true_prefix, input_alignment_file, output_file;
+   AlignmentRecord records[NUM_RECORDS];
+   MappedAlignment input_alignment;
+   vector<FaiEntry> index;
+   unsigned short int records_found;
+   
+   while ((optvalue = getopt_long(argc, argv, "hip:t:", long_options, &optindex)) != -1) {
+      switch (optvalue) {
+         case 0:
+            break;
+         case 'h':
+            helpflag = 1;
+            break;
+         case 'i':
+            interleave_flag = 1;
+            break;
+         case 'p':
+            if (optarg == 0) {
+               cerr << "Missing true haplotype prefix argument." << endl;
+               helpflag = 3;
+               break;
+            }
+            true_prefix = optarg;
+            break;
+         case 't':
+            if (optarg == 0 || atoi(optarg) <= 0) {
+               cerr << "Number of threads must be a positive integer." << endl;
+               helpflag = 3;
+               break;
+            }
+            num_threads = (unsigned int)atoi(optarg);
+            break;
+         default:
+            cerr << "Invalid argument " << optvalue << " supplied." << endl;
+            helpflag = 4;
+            break;
+      }
+   }
+   if (optind + 2 <= argc) {
+      input_alignment_file = argv[optind];
+      output_file = argv[optind+1];
+      if (!input_alignment.open(input_alignment_file, num_threads)) {
+         cerr << status_message(5) << endl;
+         helpflag = 5;
+      }
+   } else {
+      cerr << "Missing input alignment or output cache file path." << endl;
+      helpflag = 6;
+   }
+   if (helpflag) {
+      cout << "Usage: " << argv[0] << " -p true_haplotype_prefix input_alignment.fa output.hsa" << endl;
+      cout << " p\t\t\tPrefix of the header string for each true haplotype" << endl;
+      cout << " i\t\t\tInterleave the four records column by column, so evaluation reads one stream" << endl;
+      cout << " t\t\t\tNumber of threads for decompressing BGZF input" << endl;
+      cout << " output.hsa\t\tPacked alignment cache to write, which can then be evaluated in place of the alignment" << endl;
+      return helpflag;
+   }
+   if (input_alignment.failed()) {
+      cerr << "An error occurred while decompressing the input alignment file." << endl;
+      return 7;
+   }
+   
+   string index_file = input_alignment_file + ".fai";
+   if (fai_is_current(index_file, input_alignment_file) && read_fai(index_file, index)) {
+      if (!read_fai_headers(input_alignment.data(), -1, input_alignment.size(), index)) {
+         cerr << "Index " << index_file << " does not match the input alignment." << endl;
+         return 10;
+      }
+      records_found = select_indexed_records(index, true_prefix, records);
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         if (records[i].found && records[i].seq_end > input_alignment.size()) {
+            cerr << "Index " << index_file << " does not match the input alignment." << endl;
+            return 10;
+         }
+      }
+   } else {
+      records_found = locate_records(input_alignment.data(), input_alignment.size(), true_prefix, records);
+   }
+   int records_status = check_records(records_found, records);
+   if (records_status != 0) {
+      cerr << status_message(records_status) << endl;
+      return records_status;
+   }
+   if (!write_hsa(output_file, input_alignment.data(), records, interleave_flag)) {
+      cerr << "Unable to write the packed alignment cache " << output_file << endl;
+      unlink(output_file.c_str());
+      return 11;
+   }
+   return 0;
+}
  
-using namespace std;
+//The truth subcommand: locate the two true haplotype records of an alignment
+// and write their truth index, for evaluating test haplotypes against later:
+int truth_main(int argc, char *argv[]) {
+   int helpflag = 0;
+   unsigned int num_threads = max(1u, thread::hardware_concurrency());
+   int optvalue;
+   int optindex = 0;
+   struct option long_options[] =
+      {
+         {"help", no_argument, &helpflag, 1},
+         {"threads", required_argument, 0, 't'},
+         {"true_prefix", required_argument, 0, 'p'},
+         {0,0,0,0}
+      };
+   string true_prefix, input_alignment_file, output_file;
+   AlignmentRecord records[NUM_RECORDS];
+   MappedAlignment input_alignment;
+   
+   while ((optvalue = getopt_long(argc, argv, "hp:t:", long_options, &optindex)) != -1) {
+      switch (optvalue) {
+         case 0:
+            break;
+         case 'h':
+            helpflag = 1;
+            break;
+         case 'p':
+            if (optarg == 0) {
+               cerr << "Missing true haplotype prefix argument." << endl;
+               helpflag = 3;
+               break;
+            }
+            true_prefix = optarg;
+            break;
+         case 't':
+            if (optarg == 0 || atoi(optarg) <= 0) {
+               cerr << "Number of threads must be a positive integer." << endl;
+               helpflag = 3;
+               break;
+            }
+            num_threads = (unsigned int)atoi(optarg);
+            break;
+         default:
+            cerr << "Invalid argument " << optvalue << " supplied." << endl;
+            helpflag = 4;
+            break;
+      }
+   }
+   if (optind + 2 <= argc) {
+      input_alignment_file = argv[optind];
+      output_file = argv[optind+1];
+      if (!input_alignment.open(input_alignment_file, num_threads)) {
+         cerr << status_message(5) << endl;
+         helpflag = 5;
+      }
+   } else {
+      cerr << "Missing input alignment or output index file path." << endl;
+      helpflag = 6;
+   }
+   if (helpflag) {
+      cout << "Usage: " << argv[0] << " -p true_haplotype_prefix input_alignment.fa output.hti" << endl;
+      cout << " p\t\t\tPrefix of the header string for each true haplotype" << endl;
+      cout << " t\t\t\tNumber of threads for decompressing BGZF input" << endl;
+      cout << " input_alignment.fa\tAlignment containing the two true haplotypes (any test haplotypes are ignored)" << endl;
+      cout << " output.hti\t\tTruth index to write, which test haplotypes can then be evaluated against with -T" << endl;
+      return helpflag;
+   }
+   if (input_alignment.failed()) {
+      cerr << "An error occurred while decompressing the input alignment file." << endl;
+      return 7;
+   }
+   
+   locate_records(input_alignment.data(), input_alignment.size(), true_prefix, records);
+   if (!records[TRUE_ONE].found || !records[TRUE_TWO].found) {
+      cerr << "Input alignment must contain two true haplotype records." << endl;
+      return 8;
+   }
+   if (records[TRUE_TWO].length != records[TRUE_ONE].length) {
+      cerr << status_message(9) << endl;
+      return 9;
+   }
+   if (!write_truth_index(output_file, input_alignment.data(), records, true_prefix)) {
+      cerr << "Unable to write the truth index " << output_file << endl;
+      unlink(output_file.c_str());
+      return 13;
+   }
+   return 0;
+}
+//The merge subcommand: combine the partial results of ranges of columns that
+// together cover an alignment into the result of evaluating it in one run:
+int merge_main(int argc, char *argv[]) {
+   int helpflag = 0;
+   int run_stats_flag = 0;
+   int optvalue;
+   int optindex = 0;
+   struct option long_options[] =
+      {
+         {"help", no_argument, &helpflag, 1},
+         {"run_stats", no_argument, &run_stats_flag, 1},
+         {0,0,0,0}
+      };
+   vector<PartialResult> partials;
+   HapEvalState state;
+   
+   while ((optvalue = getopt_long(argc, argv, "hr", long_options, &optindex)) != -1) {
+      switch (optvalue) {
+         case 0:
+            break;
+         case 'h':
+            helpflag = 1;
+            break;
+         case 'r':
+            run_stats_flag = 1;
+            break;
+         default:
+            cerr << "Invalid argument " << optvalue << " supplied." << endl;
+            helpflag = 4;
+            break;
+      }
+   }
+   if (optind >= argc && !helpflag) {
+      cerr << "Missing partial result file paths." << endl;
+      helpflag = 6;
+   }
+   for (int i = optind; i < argc && !helpflag; i++) {
+      partials.push_back(PartialResult());
+      if (!read_partial(argv[i], partials.back())) {
+         cerr << "Unable to read partial result " << argv[i] << endl;
+         helpflag = 5;
+      }
+   }
+   if (helpflag) {
+      cout << "Usage: " << argv[0] << " partial.hsp..." << endl;
+      cout << " r\t\t\tAlso output statistics of the runs of columns identical in all four haplotypes" << endl;
+      cout << " partial.hsp\t\tPartial results written with -P for regions that together cover the alignment, in any order" << endl;
+      return helpflag;
+   }
+   
+   //The ranges must tile the alignment, then merging them in order gives the
+   // result of evaluating it in one pass:
+   sort(partials.begin(), partials.end(), [](const PartialResult &a, const PartialResult &b) { return a.start < b.start; });
+   uint64_t next_column = 0;
+   for (size_t i = 0; i < partials.size(); i++) {
+      if (partials[i].alignment_length != partials[0].alignment_length || partials[i].comparison != partials[0].comparison) {
+         cerr << "Partial results are from alignments of different lengths or with different comparison modes." << endl;
+         return 9;
+      }
+      if (partials[i].start != next_column) {
+         cerr << "Partial results must cover the alignment exactly once, but column "
+              << (partials[i].start > next_column ? next_column + 1 : partials[i].start + 1)
+              << (partials[i].start > next_column ? " is missing." : " is repeated.") << endl;
+         return 9;
+      }
+      HapEvalState next;
+      partial_to_state(partials[i], next);
+      merge_states(state, next);
+      next_column = partials[i].end;
+   }
+   if (next_column != partials[0].alignment_length) {
+      cerr << "Partial results must cover the alignment exactly once, but column " << next_column + 1 << " is missing." << endl;
+      return 9;
+   }
+   print_summary(state);
+   if (run_stats_flag) {
+      print_run_stats(state.runs);
+   }
+   return 0;
+}
  
 int main(int argc, char *argv[]) {
    //Argument parsing variables:
    int helpflag = 0;
    int position_output_flag = 0;
+   string event_file;
+   int run_stats_flag = 0;
+   int stream_flag = 0;
+   int index_flag = 0;
+   int pipe_flag = 0;
+   string batch_manifest_file;
+   vector<string> batch_patterns;
+   string truth_index_file;
+   string contig_pattern_string;
+   regex_t contig_pattern;
+   unsigned int ploidy = 2;
+   ColumnRange region;
+   int region_flag = 0;
+   string partial_file;
+   vector<BatchFile> batch_files;
+   SimdLevel simd_level = detect_simd_level();
+   BaseComparison comparison = COMPARE_EXACT;
+   unsigned int num_threads = max(1u, thread::hardware_concurrency());
    int optvalue;
    int optindex = 0;
-   struct option long_options[] = 
+   struct option long_options[] =
       {
          {"help", no_argument, &helpflag, 1},
          {"position_output", no_argument, &position_output_flag, 1},
+         {"events", required_argument, 0, 'e'},
+         {"run_stats", no_argument, &run_stats_flag, 1},
+         {"stream", no_argument, &stream_flag, 1},
+         {"faidx", no_argument, &index_flag, 1},
+         {"threads", required_argument, 0, 't'},
+         {"batch", required_argument, 0, 'b'},
+         {"glob", required_argument, 0, 'g'},
+         {"simd", required_argument, 0, 'm'},
+         {"compare", required_argument, 0, 'c'},
+         {"truth", required_argument, 0, 'T'},
+         {"contigs", required_argument, 0, 'C'},
+         {"ploidy", required_argument, 0, 'k'},
+         {"region", required_argument, 0, 'R'},
+         {"partial", required_argument, 0, 'P'},
          {"true_prefix", required_argument, 0, 'p'},
          {0,0,0,0}
       };
    string true_prefix, input_alignment_file;
    //Core algorithm variables:
-   string true_one_header = "", true_two_header = "", test_one_header = "", test_two_header = "", line_buffer;
-   string true_one, true_two, test_one, test_two;
-   unsigned short int test_one_id = 0, test_two_id = 0;
-   unsigned long int test_one_switches = 0, test_two_switches = 0,
-                     test_one_false_snps = 0, test_two_false_snps = 0,
-                     test_one_false_indels = 0, test_two_false_indels = 0,
-                     test_one_bad_calls = 0, test_two_bad_calls = 0;
-   ifstream input_alignment;
-   unsigned short int record_num = 0;
+   AlignmentRecord records[NUM_RECORDS];
+   HapEvalState state;
+   EventReporting reporting;
+   MappedAlignment input_alignment;
+   MappedAlignment truth_index_map;
+   TruthIndex truth;
+   int input_alignment_fd = -1;
+   size_t input_alignment_size;
+   unsigned int inflate_threads = 0; //Threads inflating each cursor's stream, if streaming gzipped input
+   string index_file;
+   vector<FaiEntry> index;
+   unsigned short int records_found;
+   bool records_complete;
+   
+   //Select the kernels for the CPU before anything is parsed:
+   select_simd_kernels(detect_simd_level());
+   
+   //Subcommands:
+   if (argc > 1 && strcmp(argv[1], "pack") == 0) {
+      return pack_main(argc - 1, argv + 1);
+   }
+   if (argc > 1 && strcmp(argv[1], "truth") == 0) {
+      return truth_main(argc - 1, argv + 1);
+   }
+   if (argc > 1 && strcmp(argv[1], "merge") == 0) {
+      return merge_main(argc - 1, argv + 1);
+   }
    
    //Parse input arguments with getopt_long:
-   while ((optvalue = getopt_long(argc, argv, "hop:", long_options, &optindex)) != -1) {
+   while ((optvalue = getopt_long(argc, argv, "hose:rfp:t:b:g:m:c:T:C:k:R:P:", long_options, &optindex)) != -1) {
       switch (optvalue) {
          case 0:
             //Flag was set, so skip
@@ -72,6 +5197,24 @@ int main(int argc, char *argv[]) {
          case 'o':
             position_output_flag = 1;
             break;
+         case 's':
+            stream_flag = 1;
+            break;
+         case 'r':
+            run_stats_flag = 1;
+            break;
+         case 'e':
+            //Set the file to write binary event records to
+            if (optarg == 0) {
+               cerr << "Missing event file argument." << endl;
+               helpflag = 3;
+               break;
+            }
+            event_file = optarg;
+            break;
+         case 'f':
+            index_flag = 1;
+            break;
          case 'p':
             //Set the true haplotype prefix
             if (optarg == 0) {
@@ -81,6 +5224,126 @@ int main(int argc, char *argv[]) {
             }
             true_prefix = optarg;
             break;
+         case 't':
+            //Set the number of worker threads
+            if (optarg == 0 || atoi(optarg) <= 0) {
+               cerr << "Number of threads must be a positive integer." << endl;
+               helpflag = 3;
+               break;
+            }
+            num_threads = (unsigned int)atoi(optarg);
+            break;
+         case 'b':
+            //Set the manifest of alignments to evaluate as a batch
+            if (optarg == 0) {
+               cerr << "Missing batch manifest argument." << endl;
+               helpflag = 3;
+               break;
+            }
+            batch_manifest_file = optarg;
+            break;
+         case 'g':
+            //Add the alignments matching a glob pattern to the batch
+            if (optarg == 0) {
+               cerr << "Missing batch glob pattern argument." << endl;
+               helpflag = 3;
+               break;
+            }
+            batch_patterns.push_back(optarg);
+            break;
+         case 'm':
+            //Force an instruction set variant of the kernels
+            {
+               int level = SIMD_TABLE;
+               while (level <= SIMD_AVX512BW && (optarg == 0 || strcmp(optarg, SIMD_LEVEL_NAMES[level]) != 0)) {
+                  level++;
+               }
+               if (level > SIMD_AVX512BW) {
+                  cerr << "Instruction set variant must be one of table, scalar, sse4.2, avx2 or avx512bw." << endl;
+                  helpflag = 3;
+               } else if (level > detect_simd_level()) {
+                  cerr << "This CPU does not support the " << SIMD_LEVEL_NAMES[level] << " variant." << endl;
+                  helpflag = 3;
+               } else {
+                  simd_level = (SimdLevel)level;
+               }
+            }
+            break;
+         case 'T':
+            //Set the truth index to evaluate the test haplotypes against
+            if (optarg == 0) {
+               cerr << "Missing truth index argument." << endl;
+               helpflag = 3;
+               break;
+            }
+            truth_index_file = optarg;
+            break;
+         case 'R':
+            //Set the (1-based, inclusive) range of columns to evaluate
+            {
+               char *start_end = 0, *end_end = 0;
+               unsigned long long int start = optarg != 0 ? strtoull(optarg, &start_end, 10) : 0;
+               unsigned long long int end = start_end != 0 && *start_end == '-' ? strtoull(start_end + 1, &end_end, 10) : 0;
+               if (start == 0 || end_end == 0 || end_end == start_end + 1 || *end_end != 0 || end < start) {
+                  cerr << "Region must be given as start-end, the first and last columns counting from 1." << endl;
+                  helpflag = 3;
+                  break;
+               }
+               region.start = (size_t)(start - 1);
+               region.end = (size_t)end;
+               region_flag = 1;
+            }
+            break;
+         case 'P':
+            //Set the file to write the partial result to
+            if (optarg == 0) {
+               cerr << "Missing partial result file argument." << endl;
+               helpflag = 3;
+               break;
+            }
+            partial_file = optarg;
+            break;
+         case 'k':
+            //Set the number of true (and of test) haplotypes
+            if (optarg == 0 || atoi(optarg) < 2 || atoi(optarg) > (int)MAX_PLOIDY) {
+               cerr << "Ploidy must be an integer from 2 to " << MAX_PLOIDY << "." << endl;
+               helpflag = 3;
+               break;
+            }
+            ploidy = (unsigned int)atoi(optarg);
+            break;
+         case 'C':
+            //Set the pattern grouping the records by contig
+            if (optarg == 0 || optarg[0] == 0) {
+               cerr << "Missing contig pattern argument." << endl;
+               helpflag = 3;
+               break;
+            }
+            if (!contig_pattern_string.empty()) {
+               regfree(&contig_pattern);
+            }
+            contig_pattern_string = optarg;
+            if (regcomp(&contig_pattern, optarg, REG_EXTENDED) != 0) {
+               cerr << "Invalid contig pattern." << endl;
+               contig_pattern_string.clear();
+               helpflag = 3;
+            }
+            break;
+         case 'c':
+            //Base comparison mode
+            {
+               int mode = COMPARE_EXACT;
+               while (mode <= COMPARE_IUPAC && (optarg == 0 || strcmp(optarg, BASE_COMPARISON_NAMES[mode]) != 0)) {
+                  mode++;
+               }
+               if (mode > COMPARE_IUPAC) {
+                  cerr << "Base comparison mode must be one of exact, case or iupac." << endl;
+                  helpflag = 3;
+               } else {
+                  comparison = (BaseComparison)mode;
+               }
+            }
+            break;
          default:
             //Invalid argument
             cerr << "Invalid argument " << optvalue << " supplied." << endl;
@@ -88,10 +5351,57 @@ int main(int argc, char *argv[]) {
             break;
       }
    }
-   if (optind < argc) { //Read in the non-option argument, ignore any others
+   select_simd_kernels(simd_level, comparison);
+   if (!truth_index_file.empty()) {
+      if (!truth_index_map.open(truth_index_file, num_threads)) {
+         cerr << "Unable to open truth index file." << endl;
+         helpflag = 5;
+      }
+      stream_flag = 0; //The test haplotypes are located within the mapped file
+   }
+   if (!contig_pattern_string.empty() || ploidy != 2 || region_flag) {
+      stream_flag = 0; //The contigs, the polyploid records or the region are evaluated from the mapped file
+   }
+   if (!batch_manifest_file.empty() || !batch_patterns.empty()) { //Batch mode takes the alignments from the manifest and patterns instead
+      if (!batch_manifest_file.empty() && !read_manifest(batch_manifest_file, batch_files)) {
+         cerr << "Unable to read batch manifest file." << endl;
+         helpflag = 5;
+      }
+      for (size_t i = 0; i < batch_patterns.size(); i++) {
+         add_batch_files(batch_patterns[i], string(), batch_files);
+      }
+   } else if (optind < argc) { //Read in the non-option argument, ignore any others
       input_alignment_file = argv[optind];
-      input_alignment.open(input_alignment_file.c_str(), ios_base::in);
-      if (!input_alignment) {
+      //Standard input ("-") and other non-regular files like pipes are read sequentially:
+      struct stat file_stat;
+      pipe_flag = input_alignment_file == "-" || (stat(input_alignment_file.c_str(), &file_stat) == 0 && !S_ISREG(file_stat.st_mode));
+      if (pipe_flag) {
+         input_alignment_fd = input_alignment_file == "-" ? STDIN_FILENO : open(input_alignment_file.c_str(), O_RDONLY);
+         if (input_alignment_fd < 0) {
+            cerr << "Unable to open input alignment file." << endl;
+            helpflag = 5;
+         }
+      } else if (stream_flag) {
+         input_alignment_fd = open(input_alignment_file.c_str(), O_RDONLY);
+         char magic[sizeof(HSA_MAGIC)];
+         ssize_t magic_length = input_alignment_fd >= 0 ? pread(input_alignment_fd, magic, sizeof(magic), 0) : 0;
+         if (magic_length == (ssize_t)sizeof(magic) && is_hsa(magic, sizeof(magic))) {
+            //Packed alignment caches are small and laid out for mapping, so map them:
+            close(input_alignment_fd);
+            input_alignment_fd = -1;
+            stream_flag = 0;
+         } else if (magic_length >= 2 && is_gzip(magic, 2) && index_flag) {
+            //A .fai index holds offsets into the inflated file, so fall back to decompressing in memory:
+            cerr << "Compressed input can't be indexed when streaming, decompressing in memory instead." << endl;
+            close(input_alignment_fd);
+            input_alignment_fd = -1;
+            stream_flag = 0;
+         } else if (magic_length >= 2 && is_gzip(magic, 2)) {
+            //Each cursor inflates its own stream of the file:
+            inflate_threads = num_threads;
+         }
+      }
+      if (!pipe_flag && (stream_flag ? input_alignment_fd < 0 : !input_alignment.open(input_alignment_file, num_threads))) {
          cerr << "Unable to open input alignment file." << endl;
          helpflag = 5;
       }
@@ -99,170 +5409,289 @@ int main(int argc, char *argv[]) {
       cerr << "Missing input alignment file path." << endl;
       helpflag = 6;
    }
+   if (!event_file.empty() && position_output_flag) {
+      cerr << "Event positions can be output either as text (-o) or as binary records (-e), not both." << endl;
+      helpflag = 3;
+   } else if (!event_file.empty()) {
+      reporting.mode = EventReporting::BINARY;
+      reporting.binary_output = fopen(event_file.c_str(), "wb");
+      if (reporting.binary_output == 0) {
+         cerr << "Unable to open event file." << endl;
+         helpflag = 5;
+      }
+   } else if (position_output_flag) {
+      reporting.mode = EventReporting::TEXT;
+   }
+   if (!truth_index_file.empty() && (pipe_flag || reporting.enabled())) {
+      cerr << "A truth index can't be used with input from a pipe or with event positions output." << endl;
+      helpflag = 3;
+   }
+   if (!contig_pattern_string.empty() && (pipe_flag || reporting.enabled() || !truth_index_file.empty() ||
+                                          !batch_manifest_file.empty() || !batch_patterns.empty())) {
+      cerr << "Contigs can't be evaluated from a pipe, with event positions output, with a truth index or in batch mode." << endl;
+      helpflag = 3;
+   }
+   if (ploidy != 2 && (pipe_flag || reporting.enabled() || run_stats_flag || !truth_index_file.empty() || !contig_pattern_string.empty() ||
+                       !batch_manifest_file.empty() || !batch_patterns.empty())) {
+      cerr << "Polyploid alignments can't be evaluated from a pipe, with event positions output, with run statistics," << endl;
+      cerr << "with a truth index, by contig or in batch mode." << endl;
+      helpflag = 3;
+   }
+   if ((region_flag || !partial_file.empty()) && (pipe_flag || !truth_index_file.empty() || !contig_pattern_string.empty() || ploidy != 2 ||
+                                                 !batch_manifest_file.empty() || !batch_patterns.empty())) {
+      cerr << "A region or partial result can't be evaluated from a pipe, with a truth index, by contig, as polyploid or in batch mode." << endl;
+      helpflag = 3;
+   }
+   if (run_stats_flag && reporting.enabled()) {
+      cerr << "Run statistics are only gathered when event positions aren't output." << endl;
+      helpflag = 3;
+   }
    if (helpflag) { //If input errors or the help flag were detected, output usage and exit
       cout << "Usage: " << argv[0] << " -p true_haplotype_prefix input_alignment.fa" << endl;
+      cout << "       " << argv[0] << " -p true_haplotype_prefix -b batch_manifest.txt" << endl;
+      cout << "       " << argv[0] << " -p true_haplotype_prefix -g alignments_pattern" << endl;
+      cout << "       " << argv[0] << " -p true_haplotype_prefix -C contig_pattern genome_alignment.fa" << endl;
+      cout << "       " << argv[0] << " -p true_haplotype_prefix -k ploidy input_alignment.fa" << endl;
+      cout << "       " << argv[0] << " -p true_haplotype_prefix -R start-end -P partial.hsp input_alignment.fa" << endl;
+      cout << "       " << argv[0] << " -T truth.hti test_alignment.fa" << endl;
+      cout << "       " << argv[0] << " pack -p true_haplotype_prefix input_alignment.fa output.hsa" << endl;
+      cout << "       " << argv[0] << " truth -p true_haplotype_prefix input_alignment.fa output.hti" << endl;
+      cout << "       " << argv[0] << " merge partial.hsp..." << endl;
       cout << " p\t\t\tPrefix of the header string for each true haplotype" << endl;
-      cout << " input_alignment.fa\tPath to the MSA in FASTA format" << endl;
+      cout << " o\t\t\tOutput the position of each event" << endl;
+      cout << " e\t\t\tWrite the position and type of each event to this file as binary records" << endl;
+      cout << " r\t\t\tAlso output statistics of the runs of columns identical in all four haplotypes" << endl;
+      cout << " t\t\t\tNumber of threads for evaluating, decompressing BGZF input and reading ahead" << endl;
+      cout << " s\t\t\tStream the records through fixed-size buffers instead of mapping the file; each record of" << endl;
+      cout << " \t\t\tgzipped input is inflated through buffers of its own (without -s, the whole input is" << endl;
+      cout << " \t\t\tinflated in memory first)" << endl;
+      cout << " b\t\t\tEvaluate each alignment listed in this file, outputting a table of results; a line may be a" << endl;
+      cout << " \t\t\tglob pattern, and may give the true haplotype prefix for its alignments after a tab" << endl;
+      cout << " g\t\t\tEvaluate each alignment matching this glob pattern as a batch (may be repeated)" << endl;
+      cout << " c\t\t\tBase comparison mode: exact, case (lowercase matches uppercase) or iupac (also ambiguity codes" << endl;
+      cout << " \t\t\tmatch the bases they include), default exact" << endl;
+      cout << " m\t\t\tForce an instruction set variant of the kernels (table, scalar, sse4.2, avx2, avx512bw), default " << SIMD_LEVEL_NAMES[detect_simd_level()] << endl;
+      cout << " f\t\t\tGenerate a .fai index for the alignment, and use it to locate the records" << endl;
+      cout << " T\t\t\tEvaluate just the test haplotypes of the alignment (or of each alignment of a batch) against" << endl;
+      cout << " \t\t\tthis truth index written by the truth subcommand, by default with the true haplotype prefix" << endl;
+      cout << " \t\t\tit was written with" << endl;
+      cout << " C\t\t\tGroup the records into contigs by the part of each header matching this extended regular" << endl;
+      cout << " \t\t\texpression (or its first parenthesised subexpression), and evaluate the first two true and" << endl;
+      cout << " \t\t\ttest haplotypes of every contig, outputting a table of results and the genome-wide totals" << endl;
+      cout << " R\t\t\tEvaluate only the columns from start to end (counting from 1), seeking straight to start" << endl;
+      cout << " \t\t\tin a packed cache or an alignment with fixed-width lines, whose records a .fai index" << endl;
+      cout << " \t\t\t(see f) locates without scanning the file" << endl;
+      cout << " P\t\t\tWrite the result to this partial result file instead of outputting it, for the merge" << endl;
+      cout << " \t\t\tsubcommand to combine with those of the other regions of the alignment" << endl;
+      cout << " k\t\t\tNumber of true haplotypes, and of test haplotypes, in the alignment (2 to " << MAX_PLOIDY << "), default 2" << endl;
+      cout << " input_alignment.fa\tPath to the MSA in FASTA format, optionally gzipped or bgzipped, or - for standard input," << endl;
+      cout << " \t\t\tor to a packed alignment cache written by the pack subcommand" << endl;
       return helpflag;
    }
    
-   //WARNING: If too long of a haplotype is input using unwrapped FASTA, memory allocation issues may occur.
-   //Could resolve this by using buffered binary reads, but for version 1.0 we will ignore it.
-   //Read in the alignment records:
-   while (input_alignment.good()) {
-      getline(input_alignment, line_buffer);
-      if (line_buffer[0] == '>') { //Header line
-         if (line_buffer.find(true_prefix, 1) != string::npos) { //True haplotype record
-            if (true_one_header == "") { //First true haplotype record
-               true_one_header = line_buffer.substr(1);
-               record_num = 1;
-            } else { //Second true haplotype record
-               true_two_header = line_buffer.substr(1);
-               record_num = 2;
-            }
-         } else { //Test haplotype record
-            if (test_one_header == "") { //First test haplotype record
-               test_one_header = line_buffer.substr(1);
-               record_num = 3;
-            } else { //Second test haplotype record
-               test_two_header = line_buffer.substr(1);
-               record_num = 4;
-            }
-         }
-      } else { //FASTA line
-         //Since newlines are discarded, we can simply append each buffered line to the appropriate record
-         switch (record_num) {
-            case 1:
-               true_one.append(line_buffer);
-               break;
-            case 2:
-               true_two.append(line_buffer);
-               break;
-            case 3:
-               test_one.append(line_buffer);
-               break;
-            case 4:
-               test_two.append(line_buffer);
-               break;
-            default:
-               break;
-         }
-         //Note: Extra newlines at the end of the FASTA file are handled (discarded during getline, so append operates on "").
+   if (!truth_index_file.empty()) {
+      if (truth_index_map.failed() || !truth.open(truth_index_map.data(), truth_index_map.size())) {
+         cerr << status_message(13) << endl;
+         return 13;
+      }
+      if (true_prefix.empty()) {
+         true_prefix = truth.true_prefix();
       }
    }
-   if (!input_alignment.eof()) { //Loop was not exited on EOF, so an error occurred
-      cerr << "An error occurred while reading the input alignment file." << endl;
-      input_alignment.close();
-      return 7;
+   
+   if (!batch_manifest_file.empty() || !batch_patterns.empty()) {
+      return run_batch(batch_files, true_prefix, num_threads, truth_index_file.empty() ? 0 : &truth);
    }
-   input_alignment.close();
    
-   //Now that we have the records read in, iterate along the alignment:
-   for (size_t i = 0; i < true_one.length(); i++) {
-      if (true_one[i] == true_two[i]) { //Homozygous site
-         if (test_one[i] == '-' || test_two[i] == '-') { //False indel
-            if (test_one[i] != '-') {
-               test_one_false_indels++;
-               if (position_output_flag) {
-                  cout << "False indel at position " << i+1 << endl;
-               }
-            }
-            if (test_two[i] != '-') {
-               test_two_false_indels++;
-               if (position_output_flag) {
-                  cout << "False indel at position " << i+1 << endl;
-               }
-            }
-         } else if (test_one[i] != test_two[i]) {
-            if (test_one[i] != true_one[i]) { //False SNP
-               test_one_false_snps++;
-               if (position_output_flag) {
-                  cout << "False SNP at position " << i+1 << endl;
-               }
-            } else {
-               test_two_false_snps++;
-               if (position_output_flag) {
-                  cout << "False SNP at position " << i+1 << endl;
-               }
-            }
+   if (pipe_flag) {
+      //A pipe can only be read once, so the records are evaluated as they arrive:
+      PipeEvaluator evaluator(true_prefix, state, reporting);
+      ChunkStatus read_status = read_pipe(input_alignment_fd, evaluator, num_threads > 1, num_threads);
+      if (read_status == CHUNK_ERROR) {
+         cerr << "An error occurred while reading or decompressing the input alignment file." << endl;
+         return 7;
+      }
+      int evaluation_status = evaluator.finish();
+      if (evaluation_status != 0) {
+         cerr << status_message(evaluation_status) << endl;
+         return evaluation_status;
+      }
+      if (!close_event_output(reporting)) {
+         return 7;
+      }
+      print_summary(state);
+      if (run_stats_flag) {
+         print_run_stats(state.runs);
+      }
+      return 0;
+   }
+   
+   if (stream_flag) {
+      struct stat file_stat;
+      input_alignment_size = fstat(input_alignment_fd, &file_stat) == 0 ? (size_t)file_stat.st_size : 0;
+   } else {
+      if (input_alignment.failed()) {
+         cerr << "An error occurred while decompressing the input alignment file." << endl;
+         return 7;
+      }
+      input_alignment_size = input_alignment.size();
+      if (!truth_index_file.empty()) { //Only the test haplotypes are read, and evaluated against the truth index
+         int evaluation_status = evaluate_truth_buffer(truth, input_alignment.data(), input_alignment_size, true_prefix, state, num_threads);
+         if (evaluation_status != 0) {
+            cerr << status_message(evaluation_status) << endl;
+            return evaluation_status;
          }
-      } else { //Heterozygous SNP or indel
-         if (true_one[i] != '-' && true_two[i] != '-') { //Heterozygous SNP
-            //Check the first test haplotype:
-            if (test_one[i] == true_one[i]) {
-               if (test_one_id == 2) { //Phase switch occurred
-                  test_one_switches++;
-                  if (position_output_flag) {
-                     cout << "Test haplotype 1 switches at position " << i+1 << endl;
-                  }
-               }
-               test_one_id = 1;
-            } else if (test_one[i] == true_two[i]) {
-               if (test_one_id == 1) { //Phase switch occurred
-                  test_one_switches++;
-                  if (position_output_flag) {
-                     cout << "Test haplotype 1 switches at position " << i+1 << endl;
-                  }
-               }
-               test_one_id = 2;
-            } else {
-               test_one_bad_calls++;
-               if (position_output_flag) {
-                  cout << "Test haplotype 1 doesn't match either true haplotype at position " << i+1 << endl;
-               }
-            }
-            //Now check the second test haplotype:
-            if (test_two[i] == true_one[i]) {
-               if (test_two_id == 2) { //Phase switch occurred
-                  test_two_switches++;
-                  if (position_output_flag) {
-                     cout << "Test haplotype 2 switches at position " << i+1 << endl;
-                  }
-               }
-               test_two_id = 1;
-            } else if (test_two[i] == true_two[i]) {
-               if (test_two_id == 1) { //Phase switch occurred
-                  test_two_switches++;
-                  if (position_output_flag) {
-                     cout << "Test haplotype 2 switches at position " << i+1 << endl;
-                  }
-               }
-               test_two_id = 2;
-            } else {
-               test_two_bad_calls++;
-               if (position_output_flag) {
-                  cout << "Test haplotype 2 doesn't match either true haplotype at position " << i+1 << endl;
-               }
-            }
-         } else { //Indel
-            //Not doing anything right now with indels
-            if (position_output_flag) {
-               cout << "True indel at position " << i+1 << endl;
-            }
-            if (test_one[i] != true_one[i] && test_one[i] != true_two[i]) {
-               test_one_false_snps++;
-               if (position_output_flag) {
-                  cout << "False SNP due to test haplotype 1 at position " << i+1 << endl;
-               }
-            } else if (test_two[i] != true_one[i] && test_two[i] != true_two[i]) {
-               test_two_false_snps++;
-               if (position_output_flag) {
-                  cout << "False SNP due to test haplotype 2 at position " << i+1 << endl;
-               }
-            }
+         print_summary(state);
+         if (run_stats_flag) {
+            print_run_stats(state.runs);
+         }
+         return 0;
+      }
+      if (!contig_pattern_string.empty()) { //Locate the records of every contig, then evaluate the contigs in parallel
+         if (is_hsa(input_alignment.data(), input_alignment_size)) {
+            cerr << "A packed alignment cache holds a single contig, so can't be evaluated by contig." << endl;
+            return 3;
          }
+         vector<ContigGroup> contigs;
+         locate_contigs(input_alignment.data(), input_alignment_size, true_prefix, contig_pattern, contigs);
+         regfree(&contig_pattern);
+         if (contigs.empty()) {
+            cerr << "No record header matches the contig pattern." << endl;
+            return 8;
+         }
+         evaluate_contigs(input_alignment.data(), contigs, num_threads);
+         return print_contig_results(contigs, run_stats_flag);
+      }
+      if (ploidy != 2) { //Polyploid alignments are evaluated with a phase set per test haplotype
+         if (is_hsa(input_alignment.data(), input_alignment_size)) {
+            cerr << "A packed alignment cache holds two true and two test haplotypes, so can't be evaluated as polyploid." << endl;
+            return 3;
+         }
+         PolyploidEvalState polyploid_state(ploidy);
+         int evaluation_status = evaluate_polyploid_buffer(input_alignment.data(), input_alignment_size, true_prefix, polyploid_state);
+         if (evaluation_status != 0) {
+            cerr << status_message(evaluation_status) << endl;
+            return evaluation_status;
+         }
+         print_polyploid_summary(polyploid_state);
+         return 0;
+      }
+      if (is_hsa(input_alignment.data(), input_alignment_size)) { //Packed alignment cache, the records are already located
+         int evaluation_status = evaluate_packed_alignment(input_alignment.data(), input_alignment_size, state, reporting, num_threads, &region);
+         if (evaluation_status != 0) {
+            cerr << status_message(evaluation_status) << endl;
+            return evaluation_status;
+         }
+         if (!close_event_output(reporting)) {
+            return 7;
+         }
+         return output_result(state, region, comparison, partial_file, run_stats_flag);
       }
    }
    
-   //Output the results:
-   cout << "Haplotype switches for test haplotype 1: " << test_one_switches << endl;
-   cout << "Haplotype switches for test haplotype 2: " << test_two_switches << endl;
-   cout << "False SNPs in haplotype 1: " << test_one_false_snps << endl;
-   cout << "False SNPs in haplotype 2: " << test_two_false_snps << endl;
-   cout << "False indels in haplotype 1: " << test_one_false_indels << endl;
-   cout << "False indels in haplotype 2: " << test_two_false_indels << endl;
-   cout << "Bad base calls in haplotype 1: " << test_one_bad_calls << endl;
-   cout << "Bad base calls in haplotype 2: " << test_two_bad_calls << endl;
+   //Locate the alignment records, directly from a .fai index if one is present
+   // (or requested), otherwise either in place within the mapped file, or with
+   // one pass over the file through a fixed-size buffer when streaming:
+   index_file = input_alignment_file + ".fai";
+   if (index_flag) {
+      FaiBuilder index_builder(index);
+      bool scan_complete = true;
+      if (stream_flag) {
+         scan_complete = scan_alignment_file(input_alignment_fd, index_builder);
+      } else {
+         index_builder.consume(input_alignment.data(), input_alignment.size());
+      }
+      if (!scan_complete) {
+         cerr << "An error occurred while reading the input alignment file." << endl;
+         return 7;
+      }
+      if (!index_builder.finish()) {
+         cerr << "Unable to index the input alignment, since line lengths vary within a record." << endl;
+         return 10;
+      }
+      if (!write_fai(index_file, index)) {
+         cerr << "Unable to write the index " << index_file << endl;
+         return 10;
+      }
+   } else if (inflate_threads == 0 && fai_is_current(index_file, input_alignment_file) && !read_fai(index_file, index)) {
+      cerr << "Ignoring malformed index " << index_file << endl;
+      index.clear();
+   }
+   if (!index.empty()) {
+      if (!index_flag && !read_fai_headers(stream_flag ? 0 : input_alignment.data(), input_alignment_fd, input_alignment_size, index)) {
+         cerr << "Index " << index_file << " does not match the input alignment." << endl;
+         return 10;
+      }
+      records_found = select_indexed_records(index, true_prefix, records);
+      for (unsigned short int i = 0; i < NUM_RECORDS; i++) {
+         if (records[i].found && records[i].seq_end > input_alignment_size) {
+            cerr << "Index " << index_file << " does not match the input alignment." << endl;
+            return 10;
+         }
+      }
+   } else if (stream_flag) {
+      RecordLocator locator(true_prefix, records);
+      locator.detect_line_widths();
+      bool scan_complete = inflate_threads > 0 ? scan_compressed_alignment(input_alignment_fd, inflate_threads, locator, records)
+                                               : scan_alignment_file(input_alignment_fd, locator);
+      if (!scan_complete) {
+         cerr << status_message(7) << endl;
+         return 7;
+      }
+      records_found = locator.finish();
+   } else {
+      records_found = locate_records(input_alignment.data(), input_alignment.size(), true_prefix, records);
+   }
+   int records_status = check_records(records_found, records);
+   if (records_status == 0 && !region.clip(records[TRUE_ONE].length)) {
+      records_status = 3; //A region ending beyond the alignment, like any other malformed region
+   }
+   if (records_status != 0) {
+      cerr << status_message(records_status) << endl;
+      return records_status;
+   }
    
-   return 0;
+   //Now that we have the records located, iterate along the alignment with
+   // one cursor per record advancing in lockstep:
+   if (stream_flag && num_threads > 1) { //Read ahead on a separate thread
+      records_complete = evaluate_alignment_read_ahead(input_alignment_fd, records, state, reporting, inflate_threads);
+      close(input_alignment_fd);
+   } else if (stream_flag) {
+      StreamCursor true_one(input_alignment_fd, records[TRUE_ONE], inflate_threads), true_two(input_alignment_fd, records[TRUE_TWO], inflate_threads),
+                   test_one(input_alignment_fd, records[TEST_ONE], inflate_threads), test_two(input_alignment_fd, records[TEST_TWO], inflate_threads);
+      records_complete = evaluate_alignment(true_one, true_two, test_one, test_two, records[TRUE_ONE].length, state, reporting);
+      close(input_alignment_fd);
+   } else if (num_threads > 1 && !reporting.enabled() && records_seekable(records)) { //Split the columns (of the region) across threads
+      const char *data = input_alignment.data();
+      records_complete = evaluate_chunks_parallel([&](size_t start, size_t length, HapEvalState &chunk_state) {
+         RecordCursor true_one(data, records[TRUE_ONE], start), true_two(data, records[TRUE_TWO], start),
+                      test_one(data, records[TEST_ONE], start), test_two(data, records[TEST_TWO], start);
+         return evaluate_alignment(true_one, true_two, test_one, test_two, length, chunk_state, reporting, start);
+      }, region.length(), state, num_threads, region.start);
+      input_alignment.close();
+   } else if (records_seekable(records)) { //Seek straight to the start of the region, if any
+      const char *data = input_alignment.data();
+      RecordCursor true_one(data, records[TRUE_ONE], region.start), true_two(data, records[TRUE_TWO], region.start),
+                   test_one(data, records[TEST_ONE], region.start), test_two(data, records[TEST_TWO], region.start);
+      records_complete = evaluate_alignment(true_one, true_two, test_one, test_two, region.length(), state, reporting, region.start);
+      input_alignment.close();
+   } else { //Line lengths vary, so the cursors have to step along to the start of the region
+      const char *data = input_alignment.data();
+      RecordCursor true_one(data, records[TRUE_ONE]), true_two(data, records[TRUE_TWO]),
+                   test_one(data, records[TEST_ONE]), test_two(data, records[TEST_TWO]);
+      records_complete = skip_columns(true_one, region.start) && skip_columns(true_two, region.start) &&
+                         skip_columns(test_one, region.start) && skip_columns(test_two, region.start) &&
+                         evaluate_alignment(true_one, true_two, test_one, test_two, region.length(), state, reporting, region.start);
+      input_alignment.close();
+   }
+   if (!records_complete) {
+      cerr << "An error occurred while reading the input alignment file." << endl;
+      return 7;
+   }
+   
+   //Output the results:
+   if (!close_event_output(reporting)) {
+      return 7;
+   }
+   return output_result(state, region, comparison, partial_file, run_stats_flag);
 }
\ No newline at end of file